@@ -0,0 +1,444 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ep1.h"
+
+/**
+ * Minimum amount of measured time each benchmark should accumulate before
+ * its numbers are reported.
+ */
+#define MIN_BENCH_NS 200000000L
+
+#define TRACE_LINE_LEN 64
+
+typedef struct bench_result {
+    long ops;
+    long ns;
+    long allocs;
+} bench_result_t;
+
+typedef void (*bench_fn)(int size, bench_result_t* result);
+
+/**
+ * The benchmark is linked with -Wl,--wrap=malloc, so every malloc done by
+ * ep1.c goes through here first and gets counted.
+ */
+long allocations = 0;
+
+void* __real_malloc(size_t size);
+
+void* __wrap_malloc(size_t size) {
+    allocations++;
+    return __real_malloc(size);
+}
+
+
+
+/* =========================== */
+/*         Measurement         */
+/* =========================== */
+
+struct timespec measure_started_at;
+long measure_allocations;
+
+long elapsed_ns(struct timespec* from, struct timespec* to) {
+    return (to->tv_sec - from->tv_sec) * 1000000000L + (to->tv_nsec - from->tv_nsec);
+}
+
+/**
+ * Marks the beginning of a measured section. Anything done before this call
+ * (setup) is neither timed nor counted as allocation.
+ */
+void start_measure() {
+    measure_allocations = allocations;
+    clock_gettime(CLOCK_MONOTONIC, &measure_started_at);
+}
+
+/**
+ * Closes the measured section, crediting `ops` operations to the result.
+ */
+void stop_measure(bench_result_t* result, long ops) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    result->ns += elapsed_ns(&measure_started_at, &now);
+    result->allocs += allocations - measure_allocations;
+    result->ops += ops;
+}
+
+
+
+/* =========================== */
+/*          Fixtures           */
+/* =========================== */
+
+/**
+ * Creates `size` jobs with unique names – remove_job compares by name – and
+ * pseudo-random remaining times.
+ */
+job_t** make_jobs(int size) {
+    job_t** jobs;
+    int i;
+
+    jobs = (job_t**) malloc(size * sizeof(job_t*));
+    for (i = 0; i < size; i++) {
+        jobs[i] = new_job();
+        sprintf(jobs[i]->name, "p%d", i);
+        jobs[i]->t0 = i;
+        jobs[i]->dt = 1 + rand() % 20;
+        jobs[i]->deadline = jobs[i]->t0 + 2 * jobs[i]->dt;
+        jobs[i]->remaining = jobs[i]->dt;
+    }
+    return jobs;
+}
+
+void free_job_array(job_t** jobs, int size) {
+    int i;
+
+    for (i = 0; i < size; i++) {
+        free(jobs[i]);
+    }
+    free(jobs);
+}
+
+/**
+ * Writes a trace with `size` jobs in the same format read by read_job. Two
+ * jobs arrive per second and, just like the traces shipped with the EP, the
+ * last line has no trailing newline.
+ */
+char* make_trace(int size) {
+    char* trace;
+    int i, t0, dt, len;
+
+    trace = (char*) malloc(size * TRACE_LINE_LEN + 1);
+    len = 0;
+    for (i = 0; i < size; i++) {
+        t0 = i / 2;
+        dt = 1 + rand() % 10;
+        len += sprintf(trace + len, "p%d %d %d %d%s", i, t0, dt, t0 + 2 * dt,
+                       i == size - 1 ? "" : "\n");
+    }
+    return trace;
+}
+
+
+
+/* =========================== */
+/*    Virtual-time schedulers  */
+/* =========================== */
+
+/**
+ * Records the end of a job at a virtual instant, moving it from the ready
+ * list to the done one as finish_simulation does.
+ */
+void virtual_finish(job_t* job, job_list_t* jobs_done, job_list_t* jobs_ready, int instant) {
+    job->tf = instant;
+    append_job(jobs_done, job);
+    remove_job(jobs_ready, job);
+}
+
+/**
+ * Same loop as fcfs_run, but the clock is a counter and the selected job
+ * runs to completion right away instead of on its own thread.
+ */
+int virtual_fcfs_run(FILE* file_input, job_list_t* jobs_done) {
+    job_list_t *next_jobs, *jobs_ready;
+    job_t* curr_job;
+    int instant;
+
+    next_jobs = new_job_list();
+    jobs_ready = new_job_list();
+    instant = 0;
+
+    while (jobs_left(file_input, jobs_ready)) {
+        read_jobs_starting(file_input, next_jobs, instant, NOW_OR_BEFORE);
+        curr_job = append_new_jobs(next_jobs, jobs_ready);
+
+        if (curr_job && !job_finished(curr_job)) {
+            instant += curr_job->remaining;
+            curr_job->remaining = 0;
+            virtual_finish(curr_job, jobs_done, jobs_ready, instant);
+        }
+
+        next_jobs->length = 0;
+        instant += CLOCK_LEN;
+    }
+    free_jobs(next_jobs);
+    free(jobs_ready);
+
+    return 0;
+}
+
+/**
+ * Same loop as srtn_run, where each iteration consumes one second of the
+ * job at the head of the ready list.
+ */
+int virtual_srtn_run(FILE* file_input, job_list_t* jobs_done) {
+    job_list_t *next_jobs, *jobs_ready;
+    job_t *curr_job, *prev_job;
+    int instant, preemptions;
+
+    next_jobs = new_job_list();
+    jobs_ready = new_job_list();
+    curr_job = NULL;
+    instant = preemptions = 0;
+
+    while (jobs_left(file_input, jobs_ready)) {
+        prev_job = curr_job;
+
+        read_jobs_starting(file_input, next_jobs, instant, NOW);
+        curr_job = insert_new_jobs_sorted(next_jobs, jobs_ready);
+
+        if (had_preemption(prev_job, curr_job)) {
+            preemptions++;
+        }
+        if (curr_job && !job_finished(curr_job)) {
+            curr_job->remaining -= CLOCK_LEN;
+            if (job_finished(curr_job)) {
+                virtual_finish(curr_job, jobs_done, jobs_ready, instant + CLOCK_LEN);
+            }
+        }
+
+        next_jobs->length = 0;
+        instant += CLOCK_LEN;
+    }
+    free_jobs(next_jobs);
+    free(jobs_ready);
+
+    return preemptions;
+}
+
+/**
+ * Same loop as round_robin_run. The running job is kept out of the ready
+ * list, so the loop also goes on while it is unfinished.
+ */
+int virtual_round_robin_run(FILE* file_input, job_list_t* jobs_done) {
+    job_list_t *next_jobs, *jobs_ready;
+    job_t *curr_job, *prev_job;
+    int instant, preemptions;
+
+    next_jobs = new_job_list();
+    jobs_ready = new_job_list();
+    curr_job = NULL;
+    instant = preemptions = 0;
+
+    while (jobs_left(file_input, jobs_ready) || (curr_job && !job_finished(curr_job))) {
+        prev_job = curr_job;
+
+        read_jobs_starting(file_input, next_jobs, instant, NOW);
+        if (!job_finished(curr_job)) {
+            append_job(next_jobs, curr_job);
+        }
+
+        curr_job = append_new_jobs(next_jobs, jobs_ready);
+        remove_job(jobs_ready, curr_job);
+
+        if (had_preemption(prev_job, curr_job)) {
+            preemptions++;
+        }
+        if (curr_job && !job_finished(curr_job)) {
+            curr_job->remaining -= CLOCK_LEN;
+            if (job_finished(curr_job)) {
+                virtual_finish(curr_job, jobs_done, jobs_ready, instant + CLOCK_LEN);
+            }
+        }
+
+        next_jobs->length = 0;
+        instant += CLOCK_LEN;
+    }
+    free_jobs(next_jobs);
+    free(jobs_ready);
+
+    return preemptions;
+}
+
+
+
+/* =========================== */
+/*         Benchmarks          */
+/* =========================== */
+
+/**
+ * Builds a ready list of `size` jobs through insert_sorted. Each insertion
+ * is one op, so the figure is the average over a queue growing up to `size`.
+ */
+void bench_insert_sorted(int size, bench_result_t* result) {
+    job_list_t* jobs_ready;
+    job_t** jobs;
+    int i;
+
+    jobs = make_jobs(size);
+    jobs_ready = new_job_list();
+
+    start_measure();
+    for (i = 0; i < size; i++) {
+        insert_sorted(jobs_ready, jobs[i]);
+    }
+    stop_measure(result, size);
+
+    free(jobs_ready);
+    free_job_array(jobs, size);
+}
+
+/**
+ * Empties a ready list of `size` jobs through remove_job, in random order.
+ */
+void bench_remove_job(int size, bench_result_t* result) {
+    job_list_t* jobs_ready;
+    job_t** jobs;
+    job_t* tmp;
+    int i, k;
+
+    jobs = make_jobs(size);
+    jobs_ready = new_job_list();
+    for (i = 0; i < size; i++) {
+        append_job(jobs_ready, jobs[i]);
+    }
+
+    /**
+     * The removal order is shuffled in the job array itself; the list keeps
+     * the original order.
+     */
+    for (i = size - 1; i > 0; i--) {
+        k = rand() % (i + 1);
+        tmp = jobs[i];
+        jobs[i] = jobs[k];
+        jobs[k] = tmp;
+    }
+
+    start_measure();
+    for (i = 0; i < size; i++) {
+        remove_job(jobs_ready, jobs[i]);
+    }
+    stop_measure(result, size);
+
+    free(jobs_ready);
+    free_job_array(jobs, size);
+}
+
+/**
+ * Appends `size` new jobs to an empty ready list. Each call is one op.
+ */
+void bench_append_new_jobs(int size, bench_result_t* result) {
+    job_list_t *next_jobs, *jobs_ready;
+    job_t** jobs;
+    int i, calls;
+
+    calls = 1000;
+    jobs = make_jobs(size);
+    next_jobs = new_job_list();
+    jobs_ready = new_job_list();
+    for (i = 0; i < size; i++) {
+        append_job(next_jobs, jobs[i]);
+    }
+
+    start_measure();
+    for (i = 0; i < calls; i++) {
+        jobs_ready->length = 0;
+        append_new_jobs(next_jobs, jobs_ready);
+    }
+    stop_measure(result, calls);
+
+    free(next_jobs);
+    free(jobs_ready);
+    free_job_array(jobs, size);
+}
+
+/**
+ * Parses `size` trace lines through read_job. Each line is one op.
+ */
+void bench_read_job(int size, bench_result_t* result) {
+    char (*lines)[TRACE_LINE_LEN];
+    job_t** jobs;
+    int i;
+
+    lines = malloc(size * sizeof(*lines));
+    jobs = (job_t**) malloc(size * sizeof(job_t*));
+    for (i = 0; i < size; i++) {
+        sprintf(lines[i], "p%d %d %d %d\n", i, i, 1 + i % 20, i + 40);
+    }
+
+    start_measure();
+    for (i = 0; i < size; i++) {
+        jobs[i] = read_job(lines[i]);
+    }
+    stop_measure(result, size);
+
+    free_job_array(jobs, size);
+    free(lines);
+}
+
+/**
+ * Runs a whole trace of `size` jobs through one of the virtual schedulers.
+ * The whole run, trace parsing included, is one op.
+ */
+void bench_run(int size, bench_result_t* result, int (*run)(FILE*, job_list_t*)) {
+    job_list_t* jobs_done;
+    FILE* file_input;
+    char* trace;
+
+    trace = make_trace(size);
+    file_input = fmemopen(trace, strlen(trace), "r");
+    jobs_done = new_job_list();
+
+    start_measure();
+    run(file_input, jobs_done);
+    stop_measure(result, 1);
+
+    free_jobs(jobs_done);
+    fclose(file_input);
+    free(trace);
+}
+
+void bench_fcfs_run(int size, bench_result_t* result) {
+    bench_run(size, result, virtual_fcfs_run);
+}
+
+void bench_srtn_run(int size, bench_result_t* result) {
+    bench_run(size, result, virtual_srtn_run);
+}
+
+void bench_round_robin_run(int size, bench_result_t* result) {
+    bench_run(size, result, virtual_round_robin_run);
+}
+
+
+
+/**
+ * Repeats a benchmark until it accumulates MIN_BENCH_NS of measured time
+ * and prints one line with its per-op figures.
+ */
+void report(const char* name, bench_fn fn, int size) {
+    bench_result_t result = { 0, 0, 0 };
+
+    srand(size);
+    while (result.ns < MIN_BENCH_NS) {
+        fn(size, &result);
+    }
+    printf("%-20s %6d %14.1f %12.2f\n", name, size,
+           (double) result.ns / result.ops, (double) result.allocs / result.ops);
+}
+
+
+int main() {
+    int sizes[] = { 10, 100, MAX_JOBS };
+    int i, n_sizes;
+
+    n_sizes = sizeof(sizes) / sizeof(sizes[0]);
+
+    printf("%-20s %6s %14s %12s\n", "benchmark", "size", "ns/op", "allocs/op");
+    for (i = 0; i < n_sizes; i++) {
+        report("insert_sorted", bench_insert_sorted, sizes[i]);
+        report("remove_job", bench_remove_job, sizes[i]);
+        report("append_new_jobs", bench_append_new_jobs, sizes[i]);
+        report("read_job", bench_read_job, sizes[i]);
+        report("fcfs_run", bench_fcfs_run, sizes[i]);
+        report("srtn_run", bench_srtn_run, sizes[i]);
+        report("round_robin_run", bench_round_robin_run, sizes[i]);
+    }
+
+    return 0;
+}
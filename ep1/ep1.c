@@ -134,7 +134,7 @@ void remove_job(job_list_t* jobs, job_t* job) {
         return;
     }
 
-    while (i < jobs->length) {
+    while (i < jobs->length - 1) {
         jobs->list[i] = jobs->list[i+1];
         i++;
     }
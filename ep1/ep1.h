@@ -1,4 +1,5 @@
 #include <pthread.h>
+#include <stdio.h>
 
 #define MAX_JOBS 1000
 #define MAX_LINE_LEN 1000
@@ -37,4 +38,25 @@ typedef struct sim_state {
     job_list_t* jobs_ready;
     time_t started_at;          // Instant at which the simulation started
     pthread_mutex_t mutex;      // Orchestrate operations to jobs_done and jobs_ready accross threads
-} job_simulation_t;
\ No newline at end of file
+} job_simulation_t;
+
+/* =========================== */
+/*      Job list primitives    */
+/* =========================== */
+
+job_t* new_job();
+job_list_t* new_job_list();
+void free_jobs(job_list_t* jobs);
+
+int jobs_left(FILE* file, job_list_t* jobs_ready);
+int job_finished(job_t* job);
+int had_preemption(job_t* prev_job, job_t* curr_job);
+
+void remove_job(job_list_t* jobs, job_t* job);
+void insert_sorted(job_list_t* jobs, job_t* new_job);
+void append_job(job_list_t* jobs, job_t* job);
+job_t* append_new_jobs(job_list_t* next_jobs, job_list_t* jobs_ready);
+job_t* insert_new_jobs_sorted(job_list_t* next_jobs, job_list_t* jobs_ready);
+
+job_t* read_job(char* job_data);
+void read_jobs_starting(FILE* file, job_list_t* next_jobs, int instant, int moment);
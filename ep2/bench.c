@@ -0,0 +1,475 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "ep2.h"
+#include "corrida.h"
+
+/**
+ * Quanto tempo cada medição roda, em nanossegundos.
+ */
+#define DURACAO_MEDICAO 500000000L
+
+#define SEMENTE_BENCH 42
+
+/**
+ * Cenário de estresse: milhares de ciclistas numa pista curta, disputando as mesmas
+ * posições a partir de várias threads ao mesmo tempo.
+ */
+#define D_ESTRESSE 1000
+#define N_ESTRESSE 4000
+#define THREADS_ESTRESSE 8
+
+/**
+ * Corrida usada para medir a escalabilidade do motor de segmentos, e o maior número
+ * de workers tentado quando a máquina tem menos núcleos que isso.
+ */
+#define D_SEGMENTOS 2000
+#define N_SEGMENTOS 20
+#define WORKERS_SEGMENTOS 4
+
+/**
+ * Corridas simuladas ao mesmo tempo no pool compartilhado.
+ */
+#define N_CORRIDAS 6
+#define D_CORRIDAS 500
+#define N_CICLISTAS_CORRIDAS 30
+
+/**
+ * Ciclistas e passos usados para comparar os coletores de prontos do motor de passos.
+ */
+#define N_COLETA 100000
+#define PASSOS_COLETA 2000
+
+/**
+ * Resultado de uma medição, enviado pelo processo que a fez.
+ */
+typedef struct info_resultado {
+    double movimentos_por_s;
+    int threads;        // threads do processo durante a medição
+} resultado_t;
+
+typedef struct info_medicao {
+    simulacao_t* simulacao;
+    int primeiro;       // a thread move os ciclistas primeiro, primeiro + passo, ...
+    int passo;
+    int* fora;          // ciclistas que já deixaram a pista
+    long movimentos;
+} medicao_t;
+
+
+long agora_ns() {
+    struct timespec agora;
+
+    clock_gettime(CLOCK_MONOTONIC, &agora);
+    return agora.tv_sec * 1000000000L + agora.tv_nsec;
+}
+
+
+/**
+ * Move repetidamente, sem nenhuma espera, os ciclistas sob responsabilidade de uma
+ * thread até que DURACAO_MEDICAO tenha passado ou a corrida termine. Cada chamada a mover_ciclista conta
+ * como um movimento, mesmo que o ciclista esteja bloqueado.
+ */
+void* medir_movimentos(void* args) {
+    medicao_t* medicao = (medicao_t*) args;
+    simulacao_t* simulacao = medicao->simulacao;
+    ciclista_t* ciclista;
+    long fim, rodada;
+    int k;
+
+    /**
+     * O relógio só é consultado a cada 64 rodadas, para que ele não domine a medição
+     * quando há poucos ciclistas.
+     */
+    fim = agora_ns() + DURACAO_MEDICAO;
+    for (rodada = 0; restantes_na_corrida(simulacao) > 0 && (rodada % 64 || agora_ns() < fim); rodada++) {
+        for (k = medicao->primeiro; k < simulacao->n; k += medicao->passo) {
+            ciclista = simulacao->ciclistas[k];
+            if (medicao->fora[k]) continue;
+
+            if (ciclista->quebrado || ciclista->eliminado) {
+                remover_ciclista(simulacao, ciclista);
+                medicao->fora[k] = TRUE;
+                continue;
+            }
+            mover_ciclista(simulacao, ciclista);
+            medicao->movimentos++;
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * Quantas threads o processo tem agora, segundo o /proc, ou -1 se não der para saber.
+ */
+int threads_do_processo() {
+    FILE* status;
+    char linha[256];
+    int threads;
+
+    if ((status = fopen("/proc/self/status", "r")) == NULL) return -1;
+    threads = -1;
+    while (fgets(linha, sizeof(linha), status) != NULL) {
+        if (sscanf(linha, "Threads: %d", &threads) == 1) break;
+    }
+    fclose(status);
+
+    return threads;
+}
+
+
+/**
+ * Monta uma corrida com d metros e n ciclistas e mede quantos movimentos por segundo
+ * n_threads threads conseguem fazer sobre ela.
+ */
+resultado_t medir(int d, int n, int n_threads) {
+    resultado_t resultado;
+    pthread_t* threads;
+    medicao_t* medicoes;
+    int* fora;
+    long movimentos, inicio, duracao;
+    int t;
+    simulacao_t* simulacao;
+
+    simulacao = init_simulacao(d, n, FAIXAS_PADRAO, LARGADA_PADRAO, SEMENTE_BENCH);
+    simulacao->saida = NULL;
+    dar_largada(simulacao, d, n);
+
+    threads = (pthread_t*) malloc(n_threads * sizeof(pthread_t));
+    medicoes = (medicao_t*) malloc(n_threads * sizeof(medicao_t));
+    fora = (int*) calloc(n, sizeof(int));
+
+    inicio = agora_ns();
+    for (t = 0; t < n_threads; t++) {
+        medicoes[t].simulacao = simulacao;
+        medicoes[t].primeiro = t;
+        medicoes[t].passo = n_threads;
+        medicoes[t].fora = fora;
+        medicoes[t].movimentos = 0;
+        pthread_create(&threads[t], NULL, medir_movimentos, &medicoes[t]);
+    }
+    resultado.threads = threads_do_processo();
+
+    movimentos = 0;
+    for (t = 0; t < n_threads; t++) {
+        pthread_join(threads[t], NULL);
+        movimentos += medicoes[t].movimentos;
+    }
+    duracao = agora_ns() - inicio;
+    resultado.movimentos_por_s = movimentos / (duracao / 1e9);
+
+    free(fora);
+    free(medicoes);
+    free(threads);
+    free_simulacao(simulacao);
+
+    return resultado;
+}
+
+
+/**
+ * Faz a medição num processo filho, para que o pico de memória residente seja só o
+ * dela, e imprime uma linha da grade: d, n, workers, movimentos/s, pico de RSS em KiB
+ * e threads do processo, separados por tabulações.
+ */
+void medir_em_processo(int d, int n, int n_threads) {
+    resultado_t resultado;
+    struct rusage uso;
+    int canal[2], status;
+    pid_t filho;
+
+    if (d < (n + LARGADA_PADRAO - 1) / LARGADA_PADRAO) {
+        printf("# d=%d n=%d: os ciclistas não cabem na largada\n", d, n);
+        return;
+    }
+
+    fflush(stdout);
+    if (pipe(canal) < 0 || (filho = fork()) < 0) {
+        perror("bench");
+        exit(1);
+    }
+    if (filho == 0) {
+        close(canal[0]);
+        resultado = medir(d, n, n_threads);
+        _exit(write(canal[1], &resultado, sizeof(resultado)) == sizeof(resultado) ? 0 : 1);
+    }
+
+    close(canal[1]);
+    if (read(canal[0], &resultado, sizeof(resultado)) != sizeof(resultado)) {
+        memset(&resultado, 0, sizeof(resultado));
+    }
+    close(canal[0]);
+    wait4(filho, &status, 0, &uso);
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf("# d=%d n=%d workers=%d: a medição falhou\n", d, n, n_threads);
+        return;
+    }
+    printf("%d\t%d\t%d\t%.0f\t%ld\t%d\n", d, n, n_threads, resultado.movimentos_por_s, uso.ru_maxrss,
+           resultado.threads);
+}
+
+
+/**
+ * Depois de várias threads moverem ciclistas concorrentemente, confere se a pista
+ * ficou consistente: cada ciclista ainda na pista ocupa exatamente a posição em que
+ * acha que está, nenhuma outra posição está ocupada e a máscara de ocupação bate com
+ * a pista. Um movimento perdido ou duplicado pela troca atômica quebraria essa
+ * contagem.
+ */
+int estressar(int d, int n, int n_threads) {
+    pthread_t* threads;
+    medicao_t* medicoes;
+    int* fora;
+    ciclista_t* ciclista;
+    long movimentos;
+    int i, j, k, t, na_pista, ocupadas, inconsistentes;
+    simulacao_t* simulacao;
+
+    simulacao = init_simulacao(d, n, FAIXAS_PADRAO, LARGADA_PADRAO, SEMENTE_BENCH);
+    simulacao->saida = NULL;
+    dar_largada(simulacao, d, n);
+
+    threads = (pthread_t*) malloc(n_threads * sizeof(pthread_t));
+    medicoes = (medicao_t*) malloc(n_threads * sizeof(medicao_t));
+    fora = (int*) calloc(n, sizeof(int));
+
+    for (t = 0; t < n_threads; t++) {
+        medicoes[t].simulacao = simulacao;
+        medicoes[t].primeiro = t;
+        medicoes[t].passo = n_threads;
+        medicoes[t].fora = fora;
+        medicoes[t].movimentos = 0;
+        pthread_create(&threads[t], NULL, medir_movimentos, &medicoes[t]);
+    }
+
+    movimentos = 0;
+    for (t = 0; t < n_threads; t++) {
+        pthread_join(threads[t], NULL);
+        movimentos += medicoes[t].movimentos;
+    }
+
+    na_pista = inconsistentes = 0;
+    for (k = 0; k < n; k++) {
+        if (fora[k]) continue;
+        ciclista = simulacao->ciclistas[k];
+        na_pista++;
+        if (simulacao->pista[POSICAO(ciclista->i, ciclista->j)] != ciclista->id) {
+            inconsistentes++;
+        }
+    }
+    /**
+     * A máscara de ocupação de cada metro precisa concordar com a pista, posição a
+     * posição.
+     */
+    ocupadas = 0;
+    for (i = 0; i < d; i++) {
+        for (j = 0; j < simulacao->faixas; j++) {
+            if (ocupante(simulacao, i, j) != VAZIA) ocupadas++;
+            if ((ocupante(simulacao, i, j) != VAZIA) != !!(simulacao->ocupacao[PALAVRA(i, j)] & BIT(j))) {
+                inconsistentes++;
+            }
+        }
+    }
+
+    printf("# estresse: d=%d n=%d threads=%d movimentos=%ld na pista=%d ocupadas=%d inconsistentes=%d\n",
+           d, n, n_threads, movimentos, na_pista, ocupadas, inconsistentes);
+
+    free(fora);
+    free(medicoes);
+    free(threads);
+    free_simulacao(simulacao);
+
+    return inconsistentes == 0 && ocupadas == na_pista;
+}
+
+
+/**
+ * Roda a mesma corrida inteira no motor de segmentos com 1, 2, ..., max_workers
+ * workers e mostra o tempo de cada uma e a eficiência T1 / (workers × T), que é 1
+ * quando o ganho é linear.
+ */
+void escalar_segmentos(int d, int n, int max_workers) {
+    simulacao_t* simulacao;
+    long inicio, duracao, duracao_1;
+    int w;
+
+    printf("# %8s %8s %8s %10s %10s\n", "d", "n", "workers", "tempo(ms)", "eficiência");
+    duracao_1 = 0;
+    for (w = 1; w <= max_workers; w++) {
+        simulacao = init_simulacao(d, n, FAIXAS_PADRAO, LARGADA_PADRAO, SEMENTE_BENCH);
+        simulacao->saida = NULL;
+        dar_largada(simulacao, d, n);
+
+        inicio = agora_ns();
+        simular_em_segmentos(simulacao, w);
+        duracao = agora_ns() - inicio;
+        if (w == 1) duracao_1 = duracao;
+
+        printf("# %8d %8d %8d %10.1f %10.2f\n", d, n, w, duracao / 1e6, (double) duracao_1 / (w * duracao));
+        free_simulacao(simulacao);
+    }
+}
+
+
+/**
+ * Roda N_CORRIDAS corridas ao mesmo tempo, revezando-se entre os workers de um único
+ * pool, e confere se cada uma termina com a mesma classificação que teria se fosse
+ * simulada sozinha do começo ao fim.
+ */
+int conferir_corridas_simultaneas(int n_workers) {
+    corrida_t* corridas[N_CORRIDAS];
+    corrida_t* sozinha;
+    pool_corridas_t* pool;
+    int esperada[N_CICLISTAS_CORRIDAS], obtida[N_CICLISTAS_CORRIDAS];
+    int c, k, divergentes;
+    long inicio, duracao;
+
+    inicio = agora_ns();
+    pool = init_pool_corridas(n_workers);
+    for (c = 0; c < N_CORRIDAS; c++) {
+        corridas[c] = init_corrida(D_CORRIDAS, N_CICLISTAS_CORRIDAS, FAIXAS_PADRAO, LARGADA_PADRAO,
+                                   SEMENTE_BENCH + c);
+        submeter_corrida(pool, corridas[c]);
+    }
+    free_pool_corridas(pool);
+    duracao = agora_ns() - inicio;
+
+    divergentes = 0;
+    for (c = 0; c < N_CORRIDAS; c++) {
+        sozinha = init_corrida(D_CORRIDAS, N_CICLISTAS_CORRIDAS, FAIXAS_PADRAO, LARGADA_PADRAO,
+                               SEMENTE_BENCH + c);
+        correr_corrida(sozinha);
+        consultar_classificacao(sozinha, esperada);
+        consultar_classificacao(corridas[c], obtida);
+        for (k = 0; k < N_CICLISTAS_CORRIDAS; k++) {
+            if (esperada[k] != obtida[k]) {
+                divergentes++;
+                break;
+            }
+        }
+        free_corrida(sozinha);
+        free_corrida(corridas[c]);
+    }
+
+    printf("# corridas simultâneas: %d corridas, %d workers, %.1fms, divergentes=%d\n",
+           N_CORRIDAS, n_workers, duracao / 1e6, divergentes);
+
+    return divergentes == 0;
+}
+
+
+/**
+ * Mede quanto tempo um coletor de prontos leva para PASSOS_COLETA passos sobre os
+ * mesmos n ciclistas, e soma quantos prontos ele encontrou em cada um, na ordem, para
+ * que os coletores possam ser comparados.
+ */
+double medir_coletor(coletor_t coletor, int n, long* assinatura) {
+    int *espera, *ativo, *prontos;
+    int k, p, passo, n_prontos;
+    long inicio;
+    unsigned int estado;
+
+    espera = (int*) malloc(n * sizeof(int));
+    ativo = (int*) malloc(n * sizeof(int));
+    prontos = (int*) malloc(n * sizeof(int));
+
+    /**
+     * Esperas entre 1 e 3 passos, como nas velocidades padrão, e um décimo dos
+     * ciclistas fora da pista.
+     */
+    estado = SEMENTE_BENCH;
+    for (k = 0; k < n; k++) {
+        estado = estado * 1103515245 + 12345;
+        espera[k] = (estado >> 16) % 3;
+        ativo[k] = (estado >> 8) % 10 != 0;
+    }
+
+    *assinatura = 0;
+    inicio = agora_ns();
+    for (passo = 0; passo < PASSOS_COLETA; passo++) {
+        n_prontos = coletor(espera, ativo, n, 1, prontos);
+        for (p = 0; p < n_prontos; p++) {
+            *assinatura = *assinatura * 31 + prontos[p];
+            espera[prontos[p]] = 1 + prontos[p] % 3;
+        }
+    }
+    inicio = agora_ns() - inicio;
+
+    free(prontos);
+    free(ativo);
+    free(espera);
+
+    return inicio / 1e6;
+}
+
+
+/**
+ * Compara o coletor escalar com o AVX2, se o processador tiver AVX2. Devolve FALSE se
+ * eles discordarem.
+ */
+int comparar_coletores(int n) {
+    double escalar, avx2;
+    long assinatura_escalar, assinatura_avx2;
+
+    escalar = medir_coletor(coletar_prontos_escalar, n, &assinatura_escalar);
+    if (coletor_avx2() == NULL) {
+        printf("# coletor de prontos: n=%d passos=%d escalar=%.1fms avx2=indisponível\n",
+               n, PASSOS_COLETA, escalar);
+        return TRUE;
+    }
+    avx2 = medir_coletor(coletor_avx2(), n, &assinatura_avx2);
+    printf("# coletor de prontos: n=%d passos=%d escalar=%.1fms avx2=%.1fms iguais=%s\n",
+           n, PASSOS_COLETA, escalar, avx2, assinatura_escalar == assinatura_avx2 ? "sim" : "não");
+
+    return assinatura_escalar == assinatura_avx2;
+}
+
+
+/**
+ * A saída é legível por máquina: a grade de medições vem primeiro, uma linha por
+ * ponto com colunas separadas por tabulações, e todo o resto – cabeçalhos, pontos
+ * pulados e as demais verificações – vem em linhas começadas por #.
+ */
+int main() {
+    int ds[] = { 250, 10000, 1000000 };
+    int ns[] = { 10, 1000, 100000 };
+    int a, b, n_threads;
+
+    n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    printf("# d\tn\tworkers\tmovimentos_por_s\trss_pico_kb\tthreads\n");
+    for (a = 0; a < sizeof(ds) / sizeof(ds[0]); a++) {
+        for (b = 0; b < sizeof(ns) / sizeof(ns[0]); b++) {
+            medir_em_processo(ds[a], ns[b], 1);
+            if (n_threads > 1) {
+                medir_em_processo(ds[a], ns[b], n_threads);
+            }
+        }
+    }
+
+    if (!comparar_coletores(N_COLETA)) {
+        fprintf(stderr, "Os coletores de prontos escalar e AVX2 divergiram\n");
+        return 1;
+    }
+
+    escalar_segmentos(D_SEGMENTOS, N_SEGMENTOS, n_threads > WORKERS_SEGMENTOS ? n_threads : WORKERS_SEGMENTOS);
+
+    if (!conferir_corridas_simultaneas(n_threads > 2 ? n_threads : 2)) {
+        fprintf(stderr, "Corridas simuladas no pool divergiram das simuladas sozinhas\n");
+        return 1;
+    }
+
+    if (!estressar(D_ESTRESSE, N_ESTRESSE, THREADS_ESTRESSE)) {
+        fprintf(stderr, "Ocupação da pista inconsistente após o estresse\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "ep2.h"
+
+/**
+ * Quantas posições da pista aparecem no relatório.
+ */
+#define POSICOES_NO_RELATORIO 10
+
+static const char* nomes_travas[N_TRAVAS] = {
+    "mutex_ciclistas",
+    "mutex_rankings",
+    "mutex_fim",
+};
+
+/**
+ * Contadores de uma corrida instrumentada com --contencao. Todos são atualizados com
+ * somas atômicas relaxadas, já que várias threads os incrementam ao mesmo tempo e só
+ * são lidos depois que a corrida acaba.
+ */
+struct info_contencao {
+    long aquisicoes[N_TRAVAS];
+    long disputadas[N_TRAVAS];          // aquisições em que a trava já estava com outro
+    long espera_ns[N_TRAVAS];
+    long espera_max_ns[N_TRAVAS];
+    long histograma[N_TRAVAS][N_FAIXAS_ESPERA];  // faixa b: espera em [2^(b-1), 2^b) ns
+    int n_posicoes;
+    long* disputas;     // por posição: vezes que um ciclista perdeu a posição para outro
+    long* bloqueios;    // por posição: vezes que o ciclista ali achou o metro seguinte cheio
+};
+
+
+contencao_t* init_contencao(simulacao_t* simulacao) {
+    contencao_t* contencao;
+
+    contencao = (contencao_t*) calloc(1, sizeof(contencao_t));
+    contencao->n_posicoes = simulacao->d * simulacao->faixas;
+    contencao->disputas = (long*) calloc(contencao->n_posicoes, sizeof(long));
+    contencao->bloqueios = (long*) calloc(contencao->n_posicoes, sizeof(long));
+
+    return contencao;
+}
+
+
+void free_contencao(contencao_t* contencao) {
+    free(contencao->disputas);
+    free(contencao->bloqueios);
+    free(contencao);
+}
+
+
+long relogio_ns() {
+    struct timespec agora;
+
+    clock_gettime(CLOCK_MONOTONIC, &agora);
+    return agora.tv_sec * 1000000000L + agora.tv_nsec;
+}
+
+
+/**
+ * Versão de travar usada quando a instrumentação está ligada. O relógio só é
+ * consultado se a trava já estiver ocupada, então uma aquisição sem disputa custa
+ * apenas um trylock e uma soma.
+ */
+void travar_medindo(contencao_t* contencao, pthread_mutex_t* mutex, int classe) {
+    long inicio, espera, maximo;
+    int faixa;
+
+    __atomic_fetch_add(&contencao->aquisicoes[classe], 1, __ATOMIC_RELAXED);
+    if (pthread_mutex_trylock(mutex) == 0) return;
+
+    inicio = relogio_ns();
+    pthread_mutex_lock(mutex);
+    espera = relogio_ns() - inicio;
+
+    faixa = espera > 0 ? 64 - __builtin_clzl(espera) : 0;
+    if (faixa >= N_FAIXAS_ESPERA) faixa = N_FAIXAS_ESPERA - 1;
+
+    __atomic_fetch_add(&contencao->disputadas[classe], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&contencao->espera_ns[classe], espera, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&contencao->histograma[classe][faixa], 1, __ATOMIC_RELAXED);
+
+    maximo = __atomic_load_n(&contencao->espera_max_ns[classe], __ATOMIC_RELAXED);
+    while (espera > maximo &&
+           !__atomic_compare_exchange_n(&contencao->espera_max_ns[classe], &maximo, espera, TRUE,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+
+void contar_disputa(simulacao_t* simulacao, int i, int j) {
+    __atomic_fetch_add(&simulacao->contencao->disputas[POSICAO(i, j)], 1, __ATOMIC_RELAXED);
+}
+
+
+void contar_bloqueio(simulacao_t* simulacao, int i, int j) {
+    __atomic_fetch_add(&simulacao->contencao->bloqueios[POSICAO(i, j)], 1, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Imprime, para cada classe de trava, quantas aquisições houve, quantas precisaram
+ * esperar e a distribuição dessas esperas; depois, as posições da pista em que os
+ * ciclistas mais ficaram parados.
+ */
+void imprimir_contencao(simulacao_t* simulacao, FILE* saida) {
+    contencao_t* contencao = simulacao->contencao;
+    int mais_quentes[POSICOES_NO_RELATORIO];
+    int c, b, p, k, n_quentes;
+    long total;
+
+    fprintf(saida, "\nContenção das travas\n");
+    /**
+     * Os cabeçalhos têm acentos, que ocupam mais de um byte; por isso vão já alinhados.
+     */
+    fprintf(saida, "trava              aquisições   disputadas    espera (ms)    máxima (us)\n");
+    for (c = 0; c < N_TRAVAS; c++) {
+        fprintf(saida, "%-16s %12ld %12ld %14.3f %14.1f\n", nomes_travas[c], contencao->aquisicoes[c],
+                contencao->disputadas[c], contencao->espera_ns[c] / 1e6, contencao->espera_max_ns[c] / 1e3);
+    }
+
+    for (c = 0; c < N_TRAVAS; c++) {
+        if (!contencao->disputadas[c]) continue;
+
+        fprintf(saida, "\nEsperas em %s\n", nomes_travas[c]);
+        for (b = 0; b < N_FAIXAS_ESPERA; b++) {
+            if (!contencao->histograma[c][b]) continue;
+            fprintf(saida, "  %12ld ns – %12ld ns: %ld\n", b ? 1L << (b - 1) : 0, 1L << b,
+                    contencao->histograma[c][b]);
+        }
+    }
+
+    /**
+     * Mantém as posições mais quentes numa lista pequena e ordenada, inserindo cada
+     * posição da pista no lugar certo.
+     */
+    n_quentes = 0;
+    for (p = 0; p < contencao->n_posicoes; p++) {
+        total = contencao->disputas[p] + contencao->bloqueios[p];
+        if (!total) continue;
+
+        for (k = n_quentes; k > 0; k--) {
+            if (contencao->disputas[mais_quentes[k - 1]] + contencao->bloqueios[mais_quentes[k - 1]] >= total) break;
+            if (k < POSICOES_NO_RELATORIO) mais_quentes[k] = mais_quentes[k - 1];
+        }
+        if (k < POSICOES_NO_RELATORIO) {
+            mais_quentes[k] = p;
+            if (n_quentes < POSICOES_NO_RELATORIO) n_quentes++;
+        }
+    }
+
+    fprintf(saida, "\nPosições mais disputadas\n");
+    fprintf(saida, "%8s %6s %12s %12s\n", "metro", "faixa", "disputas", "bloqueios");
+    for (k = 0; k < n_quentes; k++) {
+        p = mais_quentes[k];
+        fprintf(saida, "%8d %6d %12ld %12ld\n", p / simulacao->faixas, p % simulacao->faixas,
+                contencao->disputas[p], contencao->bloqueios[p]);
+    }
+}
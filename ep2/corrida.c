@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <pthread.h>
+#include "ep2.h"
+#include "corrida.h"
+
+struct info_corrida {
+    simulacao_t* simulacao;
+    passos_t* passos;               // NULL depois que a corrida termina
+    int terminou;
+    pthread_mutex_t mutex;          // tomado por quem simula ou consulta a corrida
+    pthread_cond_t terminada;
+    struct info_corrida* proxima;   // fila do pool
+};
+
+/**
+ * Pool de workers compartilhado por várias corridas. As corridas prontas para
+ * avançar formam uma fila; cada worker tira a primeira, simula QUANTUM_PASSOS passos
+ * e, se ela não tiver terminado, a devolve ao fim da fila. Uma corrida nunca é
+ * simulada por dois workers ao mesmo tempo, então o motor de passos continua sem
+ * disputa nenhuma pela pista.
+ */
+struct info_pool_corridas {
+    int n_workers;
+    pthread_t* threads;
+    corrida_t* primeira;
+    corrida_t* ultima;
+    int encerrar;                   // sem novas corridas; sair quando a fila esvaziar
+    pthread_mutex_t mutex;
+    pthread_cond_t ha_corridas;
+};
+
+
+/**
+ * Embrulha uma simulação pronta para o motor de passos numa corrida.
+ */
+corrida_t* embrulhar_simulacao(simulacao_t* simulacao, passos_t* passos) {
+    corrida_t* corrida;
+
+    corrida = (corrida_t*) malloc(sizeof(corrida_t));
+    corrida->simulacao = simulacao;
+    corrida->simulacao->saida = NULL;
+    corrida->passos = passos;
+    corrida->terminou = restantes_na_corrida(simulacao) == 0;
+    corrida->proxima = NULL;
+    pthread_mutex_init(&corrida->mutex, NULL);
+    pthread_cond_init(&corrida->terminada, NULL);
+
+    return corrida;
+}
+
+
+corrida_t* init_corrida(int d, int n, int faixas, int largada, unsigned long semente) {
+    simulacao_t* simulacao;
+
+    if (n < 1 || faixas < 1 || largada < 1 || largada > faixas || d < (n + largada - 1) / largada) {
+        return NULL;
+    }
+
+    simulacao = init_simulacao(d, n, faixas, largada, semente);
+    dar_largada(simulacao, d, n);
+    return embrulhar_simulacao(simulacao, init_passos(simulacao));
+}
+
+
+corrida_t* restaurar_corrida(const char* caminho) {
+    simulacao_t* simulacao;
+    passos_t* passos;
+
+    simulacao = restaurar_simulacao(caminho, modelo_padrao(), &passos);
+    if (simulacao == NULL) return NULL;
+    return embrulhar_simulacao(simulacao, passos);
+}
+
+
+int salvar_corrida(corrida_t* corrida, const char* caminho) {
+    int ok;
+
+    pthread_mutex_lock(&corrida->mutex);
+    ok = corrida->passos != NULL && salvar_simulacao(corrida->simulacao, corrida->passos, caminho);
+    pthread_mutex_unlock(&corrida->mutex);
+
+    return ok;
+}
+
+
+void free_corrida(corrida_t* corrida) {
+    if (corrida->passos != NULL) {
+        encerrar_passos(corrida->simulacao, corrida->passos);
+    }
+    pthread_mutex_destroy(&corrida->mutex);
+    pthread_cond_destroy(&corrida->terminada);
+    free_simulacao(corrida->simulacao);
+    free(corrida);
+}
+
+
+/**
+ * Avança a corrida com a trava dela já tomada. Quando ela termina, publica os
+ * rankings das voltas que ficaram incompletas e acorda quem espera por ela.
+ */
+int avancar_travada(corrida_t* corrida, long passos) {
+    if (corrida->terminou) return FALSE;
+
+    if (!avancar_passos(corrida->simulacao, corrida->passos, passos)) {
+        encerrar_passos(corrida->simulacao, corrida->passos);
+        corrida->passos = NULL;
+        imprimir_rankings(corrida->simulacao, TRUE);
+        corrida->terminou = TRUE;
+        pthread_cond_broadcast(&corrida->terminada);
+    }
+    return !corrida->terminou;
+}
+
+
+int avancar_corrida(corrida_t* corrida, long passos) {
+    int continua;
+
+    pthread_mutex_lock(&corrida->mutex);
+    continua = avancar_travada(corrida, passos);
+    pthread_mutex_unlock(&corrida->mutex);
+
+    return continua;
+}
+
+
+void correr_corrida(corrida_t* corrida) {
+    avancar_corrida(corrida, LONG_MAX);
+}
+
+
+int corrida_terminou(corrida_t* corrida) {
+    int terminou;
+
+    pthread_mutex_lock(&corrida->mutex);
+    terminou = corrida->terminou;
+    pthread_mutex_unlock(&corrida->mutex);
+
+    return terminou;
+}
+
+
+int consultar_ranking(corrida_t* corrida, int* ids, int* volta) {
+    simulacao_t* simulacao = corrida->simulacao;
+    int k, tamanho;
+
+    pthread_mutex_lock(&corrida->mutex);
+    tamanho = simulacao->tam_ultimo_ranking;
+    for (k = 0; k < tamanho; k++) {
+        ids[k] = simulacao->ultimo_ranking[k];
+    }
+    *volta = simulacao->volta_ultimo_ranking + 1;
+    pthread_mutex_unlock(&corrida->mutex);
+
+    return tamanho;
+}
+
+
+int consultar_classificacao(corrida_t* corrida, int* ids) {
+    simulacao_t* simulacao = corrida->simulacao;
+    int k, fora;
+
+    pthread_mutex_lock(&corrida->mutex);
+    fora = simulacao->n_fora;
+    for (k = 0; k < simulacao->n; k++) {
+        ids[k] = VAZIA;
+    }
+    for (k = 0; k < fora; k++) {
+        ids[simulacao->n - 1 - k] = simulacao->ordem_de_saida[k];
+    }
+    pthread_mutex_unlock(&corrida->mutex);
+
+    return fora;
+}
+
+
+void aguardar_corrida(corrida_t* corrida) {
+    pthread_mutex_lock(&corrida->mutex);
+    while (!corrida->terminou) {
+        pthread_cond_wait(&corrida->terminada, &corrida->mutex);
+    }
+    pthread_mutex_unlock(&corrida->mutex);
+}
+
+
+/**
+ * Põe uma corrida no fim da fila; a trava do pool precisa estar tomada.
+ */
+void enfileirar_corrida(pool_corridas_t* pool, corrida_t* corrida) {
+    corrida->proxima = NULL;
+    if (pool->ultima != NULL) {
+        pool->ultima->proxima = corrida;
+    } else {
+        pool->primeira = corrida;
+    }
+    pool->ultima = corrida;
+    pthread_cond_signal(&pool->ha_corridas);
+}
+
+
+void* trabalhar_em_corridas(void* args) {
+    pool_corridas_t* pool = (pool_corridas_t*) args;
+    corrida_t* corrida;
+    int continua;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->mutex);
+        while (pool->primeira == NULL && !pool->encerrar) {
+            pthread_cond_wait(&pool->ha_corridas, &pool->mutex);
+        }
+        corrida = pool->primeira;
+        if (corrida == NULL) {
+            pthread_mutex_unlock(&pool->mutex);
+            return NULL;
+        }
+        pool->primeira = corrida->proxima;
+        if (pool->primeira == NULL) pool->ultima = NULL;
+        pthread_mutex_unlock(&pool->mutex);
+
+        continua = avancar_corrida(corrida, QUANTUM_PASSOS);
+
+        if (continua) {
+            pthread_mutex_lock(&pool->mutex);
+            enfileirar_corrida(pool, corrida);
+            pthread_mutex_unlock(&pool->mutex);
+        }
+    }
+}
+
+
+pool_corridas_t* init_pool_corridas(int n_workers) {
+    pool_corridas_t* pool;
+    int t;
+
+    if (n_workers < 1) n_workers = 1;
+
+    pool = (pool_corridas_t*) malloc(sizeof(pool_corridas_t));
+    pool->n_workers = n_workers;
+    pool->threads = (pthread_t*) malloc(n_workers * sizeof(pthread_t));
+    pool->primeira = pool->ultima = NULL;
+    pool->encerrar = FALSE;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->ha_corridas, NULL);
+
+    for (t = 0; t < n_workers; t++) {
+        pthread_create(&pool->threads[t], NULL, trabalhar_em_corridas, pool);
+    }
+
+    return pool;
+}
+
+
+void free_pool_corridas(pool_corridas_t* pool) {
+    int t;
+
+    /**
+     * Um worker só sai com a fila vazia; quem está com uma corrida inacabada nas mãos
+     * a devolve à fila e continua, então todas terminam antes do último sair.
+     */
+    pthread_mutex_lock(&pool->mutex);
+    pool->encerrar = TRUE;
+    pthread_cond_broadcast(&pool->ha_corridas);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (t = 0; t < pool->n_workers; t++) {
+        pthread_join(pool->threads[t], NULL);
+    }
+
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->ha_corridas);
+    free(pool->threads);
+    free(pool);
+}
+
+
+void submeter_corrida(pool_corridas_t* pool, corrida_t* corrida) {
+    pthread_mutex_lock(&pool->mutex);
+    enfileirar_corrida(pool, corrida);
+    pthread_mutex_unlock(&pool->mutex);
+}
@@ -0,0 +1,94 @@
+/**
+ * Interface para embutir o simulador em outro programa. Cada corrida_t é uma corrida
+ * independente, com seu próprio estado, simulada pelo motor de passos; várias podem
+ * existir ao mesmo tempo no mesmo processo.
+ *
+ * Uma corrida pode ser avançada diretamente, por quem a criou, ou entregue a um
+ * pool_corridas_t, cujos workers se revezam entre todas as corridas submetidas, um
+ * trecho de QUANTUM_PASSOS passos de cada vez. As consultas podem ser feitas a
+ * qualquer momento, inclusive enquanto um worker simula a corrida.
+ *
+ * Uma corrida criada aqui não escreve nada: os rankings de cada volta e a
+ * classificação são obtidos pelas consultas.
+ */
+
+/**
+ * Passos que um worker do pool simula de uma corrida antes de passar para a próxima.
+ */
+#define QUANTUM_PASSOS 1000
+
+typedef struct info_corrida corrida_t;
+typedef struct info_pool_corridas pool_corridas_t;
+
+/**
+ * Cria uma corrida de n ciclistas numa pista de d metros e dá a largada. Devolve NULL
+ * se os ciclistas não couberem na largada.
+ */
+corrida_t* init_corrida(int d, int n, int faixas, int largada, unsigned long semente);
+
+/**
+ * Libera a corrida. Ela não pode estar num pool que ainda a esteja simulando.
+ */
+void free_corrida(corrida_t* corrida);
+
+/**
+ * Simula até `passos` passos de INTERVAL_PASSO. Devolve TRUE enquanto a corrida não
+ * tiver terminado.
+ */
+int avancar_corrida(corrida_t* corrida, long passos);
+
+/**
+ * Simula a corrida até o fim.
+ */
+void correr_corrida(corrida_t* corrida);
+
+int corrida_terminou(corrida_t* corrida);
+
+/**
+ * Copia para ids o ranking da última volta concluída, do primeiro ao último a
+ * cruzá-la, e põe em *volta o número dela, a partir de 1 – 0 se nenhuma foi
+ * concluída. Devolve quantos ids foram copiados; ids precisa de espaço para n.
+ */
+int consultar_ranking(corrida_t* corrida, int* ids, int* volta);
+
+/**
+ * Copia para ids a classificação da corrida: ids[0] é o vencedor e ids[n - 1], o
+ * primeiro a deixar a corrida. Enquanto ela não termina, só as últimas posições – de
+ * quem já foi eliminado ou quebrou – são conhecidas, e as demais ficam com -1.
+ * Devolve quantas posições são conhecidas.
+ */
+int consultar_classificacao(corrida_t* corrida, int* ids);
+
+/**
+ * Grava a corrida num ponto de restauração (ver salvamento.c). Devolve FALSE se o
+ * arquivo não puder ser escrito ou se a corrida já tiver terminado. Numa corrida que
+ * está num pool, o ponto fica entre dois trechos de QUANTUM_PASSOS.
+ */
+int salvar_corrida(corrida_t* corrida, const char* caminho);
+
+/**
+ * Cria uma corrida a partir de um ponto de restauração; ela continua exatamente como
+ * a original continuaria. Devolve NULL se o arquivo não for válido.
+ */
+corrida_t* restaurar_corrida(const char* caminho);
+
+/**
+ * Cria um pool com n_workers threads, que ficam esperando corridas.
+ */
+pool_corridas_t* init_pool_corridas(int n_workers);
+
+/**
+ * Espera que todas as corridas submetidas terminem e encerra os workers.
+ */
+void free_pool_corridas(pool_corridas_t* pool);
+
+/**
+ * Entrega uma corrida ao pool, que a simula até o fim junto com as demais. Ela não
+ * deve ser avançada diretamente enquanto isso.
+ */
+void submeter_corrida(pool_corridas_t* pool, corrida_t* corrida);
+
+/**
+ * Bloqueia até que a corrida termine.
+ */
+void aguardar_corrida(corrida_t* corrida);
@@ -1,69 +1,15 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <pthread.h>
+#include <errno.h>
 #include <unistd.h>
-
-#define debug(...) if (DEBUG) { fprintf(stderr, __VA_ARGS__); }
-
-#define MAX_CICLISTAS 10
-#define MAX_CICLISTAS_LARGADA 5
-#define FALSE 0
-#define TRUE 1
-#define INTERVAL_120MS 120000
-#define INTERVAL_60MS  60000
-#define INTERVAL_40MS  40000
-#define INTERVAL_20MS  20000
-#define INTERVAL_1MS   1000
-
-int DEBUG = 0;
-int ha_ciclista_a_90;
-
-typedef struct info_ciclista {
-    int id;
-    int velocidade;
-    int eliminado;
-    int quebrado;
-    int i;
-    int j;
-    int volta_atual;
-    double tempo_gasto;
-    pthread_t thread;
-} ciclista_t;
-
-typedef struct info_posicao {
-    pthread_mutex_t mutex;
-    ciclista_t* ciclista;
-    int i;
-    int j;
-} posicao_t;
-
-typedef struct info_ranking {
-    int ciclistas_registrados;
-    int ciclista_eliminado;
-    int ciclistas_restantes;
-    ciclista_t** ciclistas;
-    pthread_mutex_t mutex;
-} ranking_t;
-
-typedef struct info_simulacao {
-    int d;
-    int n;
-    int ciclistas_restantes;
-    posicao_t*** pista;
-    ciclista_t** ciclistas;
-    ranking_t** ranking_voltas;
-    pthread_mutex_t mutex_ciclistas;
-} simulacao_t;
-
-
-/**
- * Variável global que guarda o estado atual da simulação.
- */
-simulacao_t* simulacao;
+#include "ep2.h"
 
 
-void print_ciclistas() {
+void print_ciclistas(simulacao_t* simulacao) {
     int i;
     ciclista_t* ciclista;
 
@@ -82,142 +28,284 @@ void print_ciclistas() {
 }
 
 
-void print_pista() {
-    int i, j;
-    posicao_t*** pista;
+void print_ranking(simulacao_t* simulacao, int volta) {
+    int i;
+    ranking_t* ranking;
 
-    pista = simulacao->pista;
+    ranking = simulacao->ranking_voltas[volta];
 
-    printf("\n");
-    for (i = 0; i < simulacao->d; i++) {
-        fprintf(stderr, "%2d: \t", (i + 1));
-        for (j = 0; j < MAX_CICLISTAS; j++) {
-            if (pista[i][j] != NULL && pista[i][j]->ciclista != NULL) {
-                fprintf(stderr, "%2d \t", pista[i][j]->ciclista->id);
-            } else {
-                fprintf(stderr, " -  \t");
-            }
-        }
-        fprintf(stderr, "\n");
+    fprintf(simulacao->saida, "\nRanking da volta %d:\n", volta + 1);
+    for (i = 0; i < ranking->ciclistas_registrados; i++) {
+        fprintf(simulacao->saida, "%4d. Ciclista %d\n", i+1, ranking->ciclistas[i]->id);
     }
 }
 
 
-void print_ranking(int volta) {
-    int i;
+/**
+ * Imprime, em ordem, os rankings das voltas já concluídas que ainda não foram
+ * impressos e libera a lista de ciclistas de cada uma delas. Assim só as voltas em
+ * andamento – entre o líder e o último colocado – ocupam memória proporcional a n.
+ * Com `pendentes`, imprime também as voltas que ficaram incompletas no fim da corrida.
+ * Os ids do último ranking liberado ficam em simulacao->ultimo_ranking, para quem
+ * consulta a corrida em vez de ler a saída.
+ */
+void imprimir_rankings(simulacao_t* simulacao, int pendentes) {
     ranking_t* ranking;
+    int k, proximo;
 
-    ranking = simulacao->ranking_voltas[volta];
+    /**
+     * Quase toda volta cruzada não fecha nenhuma volta, e então não há nada a imprimir;
+     * isso se descobre sem a trava. Quem fecha uma volta vê a própria marcação.
+     */
+    if (!pendentes) {
+        proximo = __atomic_load_n(&simulacao->proximo_ranking, __ATOMIC_ACQUIRE);
+        if (proximo >= 2*simulacao->n ||
+            !__atomic_load_n(&simulacao->ranking_voltas[proximo]->concluida, __ATOMIC_ACQUIRE)) {
+            return;
+        }
+    }
 
-    fprintf(stderr, "\nRanking da volta %d:\n", volta + 1);
-    for (i = 0; i < ranking->ciclistas_registrados; i++) {
-        fprintf(stderr, "%4d. Ciclista %d\n", i+1, ranking->ciclistas[i]->id);
+    travar(simulacao, &simulacao->mutex_rankings, TRAVA_RANKINGS);
+    while (simulacao->proximo_ranking < 2*simulacao->n) {
+        ranking = simulacao->ranking_voltas[simulacao->proximo_ranking];
+        if (!__atomic_load_n(&ranking->ciclistas_registrados, __ATOMIC_ACQUIRE) ||
+            !(__atomic_load_n(&ranking->concluida, __ATOMIC_ACQUIRE) || pendentes)) break;
+
+        if (simulacao->saida != NULL) {
+            print_ranking(simulacao, simulacao->proximo_ranking);
+        }
+
+        /**
+         * Ninguém mais registra uma volta concluída, então a lista pode ser liberada
+         * sem disputa.
+         */
+        for (k = 0; k < ranking->ciclistas_registrados; k++) {
+            simulacao->ultimo_ranking[k] = ranking->ciclistas[k]->id;
+        }
+        simulacao->tam_ultimo_ranking = ranking->ciclistas_registrados;
+        simulacao->volta_ultimo_ranking = simulacao->proximo_ranking;
+        __atomic_store_n(&ranking->concluida, TRUE, __ATOMIC_RELEASE);
+        free(ranking->ciclistas);
+        ranking->ciclistas = NULL;
+
+        __atomic_store_n(&simulacao->proximo_ranking, simulacao->proximo_ranking + 1, __ATOMIC_RELEASE);
     }
+    pthread_mutex_unlock(&simulacao->mutex_rankings);
 }
 
+
 /**
- * Define quanto tempo deve passar antes entre duas mudanças de posição
- * consecutivas.
+ * Fecha, em ordem, as voltas que ficaram completas: as que alguém já cruzou e que não
+ * têm mais nenhum ciclista da corrida pendente. Numa volta de eliminação, o último a
+ * cruzá-la que ainda está na corrida é eliminado – em geral quem acabou de fechá-la,
+ * ou outro, se quem faltava era justamente alguém que saiu da corrida. A impressão
+ * fica para imprimir_rankings.
+ *
+ * Uma volta só fica completa depois da anterior, já que ninguém a cruza sem ter
+ * cruzado a anterior, então basta olhar a partir da primeira ainda aberta. Cada volta
+ * é fechada uma só vez, o que torna esse laço O(1) amortizado.
  */
-int intervalo(ciclista_t* ciclista) {
-    switch (ciclista->velocidade) {
-        case 30:
-            return INTERVAL_120MS;
-            break;
+void fechar_voltas(simulacao_t* simulacao) {
+    ranking_t* ranking;
+    int k, volta;
 
-        case 60:
-            return INTERVAL_60MS;
+    travar(simulacao, &simulacao->mutex_rankings, TRAVA_RANKINGS);
+    for (volta = simulacao->volta_aberta; volta < 2*simulacao->n; volta++) {
+        ranking = simulacao->ranking_voltas[volta];
+        if (!__atomic_load_n(&ranking->ciclistas_registrados, __ATOMIC_ACQUIRE) ||
+            __atomic_load_n(&ranking->pendentes, __ATOMIC_ACQUIRE) > 0) {
             break;
+        }
 
-        case 90:
-            return INTERVAL_40MS;
-            break;
+        if (volta % 2 == 1 && !ranking->ciclista_eliminado) {
+            for (k = ranking->ciclistas_registrados - 1; k >= 0; k--) {
+                if (!ranking->ciclistas[k]->eliminado && !ranking->ciclistas[k]->quebrado) {
+                    eliminar_ciclista(simulacao, ranking->ciclistas[k], volta);
+                    break;
+                }
+            }
+        }
+        __atomic_store_n(&ranking->concluida, TRUE, __ATOMIC_RELEASE);
     }
-    debug("Veloc. inválida: %d\n", ciclista->velocidade);
-    exit(1);
+    simulacao->volta_aberta = volta;
+    pthread_mutex_unlock(&simulacao->mutex_rankings);
+}
+
+/**
+ * Quanto tempo, em microssegundos, deve passar entre duas mudanças de posição
+ * consecutivas de um ciclista, de acordo com a sua velocidade atual.
+ */
+int intervalo(ciclista_t* ciclista) {
+    return ciclista->simulacao->modelo->intervalos[ciclista->velocidade];
 }
 
 
 /*
  * Checa se a pista j esta livre no ponto i para o ciclista andar
  */
-int pista_livre(int i, int j){
+int pista_livre(simulacao_t* simulacao, int i, int j){
   int resultado;
 
-  resultado = (j < MAX_CICLISTAS && simulacao->pista[i][j]->ciclista == NULL)? 1 : 0;
+  resultado = (j < simulacao->faixas &&
+               !(__atomic_load_n(&simulacao->ocupacao[PALAVRA(i, j)], __ATOMIC_ACQUIRE) & BIT(j)))? 1 : 0;
 
   return resultado;
 }
 
 
 /**
- * Decide para onde mover um ciclista com base no estado atual dele, decidindo inclusive
- * se há a possibilidade de ultrapassar alguém à frente.
+ * Devolve a primeira faixa livre a partir da faixa j no metro i, ou -1 se todas
+ * estiverem ocupadas. Em vez de olhar faixa por faixa, inverte a máscara de ocupação
+ * – os bits além da última faixa estão sempre marcados como ocupados – e conta os
+ * zeros à direita, uma palavra de 64 faixas por vez.
  */
- posicao_t* proxima_posicao(ciclista_t* ciclista) {
-     int prox_i, prox_j, i, j, d, pos;
+int primeira_faixa_livre(simulacao_t* simulacao, int i, int j) {
+    int w, palavras;
+    uint64_t livres;
+    uint64_t* mascara;
+
+    palavras = simulacao->palavras_por_metro;
+    mascara = &simulacao->ocupacao[(long) i * palavras];
+
+    w = (unsigned) j / BITS_POR_PALAVRA;
+    livres = ~__atomic_load_n(&mascara[w], __ATOMIC_ACQUIRE) & (~UINT64_C(0) << ((unsigned) j % BITS_POR_PALAVRA));
+    while (!livres) {
+        if (++w == palavras) return -1;
+        livres = ~__atomic_load_n(&mascara[w], __ATOMIC_ACQUIRE);
+    }
 
-     i=ciclista->i;
-     j=ciclista->j;
-     d=simulacao->d;
+    return w * BITS_POR_PALAVRA + __builtin_ctzll(livres);
+}
 
-     for(pos=j+1; pos<10; pos++){
-       if(pista_livre((i+1)%d, pos)) break;
-     }
 
-     if(!pista_livre((i+1)%d, j) && pos==10)
-       return simulacao->pista[i][j];
+/**
+ * Decide para onde mover um ciclista que está no metro i, faixa j, decidindo inclusive
+ * se há a possibilidade de ultrapassar alguém à frente. O destino é escrito em
+ * prox_i e prox_j; se não houver para onde ir, eles recebem a própria posição atual
+ * e a função devolve FALSE.
+ *
+ * Seguir na mesma faixa e ultrapassar por uma faixa externa se resumem a achar a
+ * primeira faixa livre a partir de j no metro seguinte.
+ */
+ int proxima_posicao(simulacao_t* simulacao, int i, int j, int* prox_i, int* prox_j) {
+     int pos, prox;
+
+     prox = (i + 1) % simulacao->d;
+     pos = primeira_faixa_livre(simulacao, prox, j);
 
-     prox_i = (i + 1) % d;
-     prox_j = (pista_livre((i+1)%d, j) || pos==10) ? j : pos;
+     if (pos < 0) {
+       *prox_i = i;
+       *prox_j = j;
+       return FALSE;
+     }
 
-     return simulacao->pista[prox_i][prox_j];
+     *prox_i = prox;
+     *prox_j = pos;
+     return TRUE;
  }
 
 
 /**
  * Decide qual a nova velocidade do ciclista com base na velocidade atual e nas
- * regras de negócio:
+ * tabelas do modelo de velocidades (velocidades.c): um sorteio de 0 a N_SORTEIOS - 1
+ * indexa a linha da velocidade atual no regime em vigor. No modelo padrão:
  *
  * 30km/h => 80% para 60km/h | 20% para 30km/h
  * 60km/h => 60% para 60km/h | 40% para 30km/h
  *
  * Quando houver 3 ciclistas restantes => 1 ciclista tem 10% de chance para 90 km/h
  */
-void mudar_velocidade(ciclista_t* ciclista){
-  int nova_velocidade;
-
-  nova_velocidade = rand() % 100;
-
-  if (simulacao->ciclistas_restantes == 3 && !ha_ciclista_a_90){
-    switch (ciclista->velocidade){
-        case 30:
-            if (nova_velocidade > 18 && nova_velocidade < 90) {
-                ciclista->velocidade = 60;
-            } else if(nova_velocidade > 90) {
-                ciclista->velocidade = 90;
-                ha_ciclista_a_90 = 1;
-            }
-            break;
-        case 60:
-            if (nova_velocidade < 36) {
-                ciclista->velocidade = 30;
-            } else if (nova_velocidade > 90) {
-                ciclista->velocidade = 90;
-                ha_ciclista_a_90 = 1;
-            }
-            break;
+void mudar_velocidade(simulacao_t* simulacao, ciclista_t* ciclista) {
+    modelo_t* modelo = simulacao->modelo;
+    int sorteio, regime;
+
+    sorteio = prng_sortear(&ciclista->prng, N_SORTEIOS);
+    regime = (restantes_na_corrida(simulacao) == modelo->restantes_final && !simulacao->ha_ciclista_a_90)
+             ? REGIME_FINAL : REGIME_NORMAL;
+
+    ciclista->velocidade = modelo->proxima[regime][ciclista->velocidade][sorteio];
+    simulacao->ha_ciclista_a_90 |= regime == REGIME_FINAL && modelo->encerra_final[ciclista->velocidade];
+}
+
+
+/**
+ * Tira um ciclista que deixou a corrida da contagem de restantes e das pendentes da
+ * volta que ele ainda cruzaria. As voltas que ficarem completas com isso são fechadas
+ * por quem chamou, com fechar_voltas.
+ */
+void descontar_ciclista(simulacao_t* simulacao, ciclista_t* ciclista) {
+    int volta;
+
+    /**
+     * A troca atômica decide a corrida com o próprio ciclista cruzando a linha em
+     * registrar_ranking: ou ele é descontado da volta que ia registrar, ou da seguinte.
+     */
+    volta = __atomic_exchange_n(&ciclista->volta_pendente, SAIU, __ATOMIC_ACQ_REL);
+    if (volta == SAIU) return;
+    __atomic_sub_fetch(&simulacao->ranking_voltas[volta]->pendentes, 1, __ATOMIC_ACQ_REL);
+
+    /**
+     * Quem tirar o último ciclista da corrida avisa a thread principal, que fica
+     * esperando por isso em aguardar_fim_da_corrida.
+     */
+    if (__atomic_sub_fetch(&simulacao->ciclistas_restantes, 1, __ATOMIC_ACQ_REL) == 0) {
+        travar(simulacao, &simulacao->mutex_fim, TRAVA_FIM);
+        pthread_cond_broadcast(&simulacao->fim_da_corrida);
+        pthread_mutex_unlock(&simulacao->mutex_fim);
     }
-  } else {
-    switch (ciclista->velocidade){
-      case 30:
-          ciclista->velocidade = (nova_velocidade < 20) ? 30 : 60;
-          break;
-      case 60:
-          ciclista->velocidade = (nova_velocidade < 40) ? 30 : 60;
-          break;
+}
+
+
+/**
+ * Bloqueia até que a corrida termine ou até que se passem `timeout` microssegundos –
+ * zero espera sem limite. Devolve TRUE se a corrida terminou.
+ */
+int aguardar_fim_da_corrida(simulacao_t* simulacao, int timeout) {
+    struct timespec limite;
+    int terminou;
+
+    if (timeout) {
+        clock_gettime(CLOCK_REALTIME, &limite);
+        limite.tv_nsec += (long) timeout * 1000;
+        limite.tv_sec += limite.tv_nsec / 1000000000L;
+        limite.tv_nsec %= 1000000000L;
+    }
+
+    travar(simulacao, &simulacao->mutex_fim, TRAVA_FIM);
+    while (restantes_na_corrida(simulacao) > 0) {
+        if (!timeout) {
+            pthread_cond_wait(&simulacao->fim_da_corrida, &simulacao->mutex_fim);
+        } else if (pthread_cond_timedwait(&simulacao->fim_da_corrida, &simulacao->mutex_fim,
+                                          &limite) == ETIMEDOUT) {
+            break;
+        }
     }
-  }
+    terminou = restantes_na_corrida(simulacao) == 0;
+    pthread_mutex_unlock(&simulacao->mutex_fim);
+
+    return terminou;
+}
+
+
+/**
+ * Anota que um ciclista deixou a corrida, eliminado ou quebrado. Como o vencedor é o
+ * último a ser eliminado, a ordem de saída lida de trás para frente é a classificação
+ * final.
+ */
+void registrar_saida(simulacao_t* simulacao, ciclista_t* ciclista) {
+    simulacao->ordem_de_saida[__atomic_fetch_add(&simulacao->n_fora, 1, __ATOMIC_ACQ_REL)] = ciclista->id;
+}
+
+
+/**
+ * Elimina um ciclista por ter sido o último a cruzar a volta de índice `volta`. Note
+ * que ele pode já estar à frente – e registrado em voltas posteriores.
+ */
+void eliminar_ciclista(simulacao_t* simulacao, ciclista_t* ciclista, int volta) {
+    ciclista->eliminado = 1;
+    registrar_saida(simulacao, ciclista);
+    simulacao->ranking_voltas[volta]->ciclista_eliminado = 1;
+    descontar_ciclista(simulacao, ciclista);
 }
 
 
@@ -225,19 +313,25 @@ void mudar_velocidade(ciclista_t* ciclista){
  * Função que guarda a lógica de quebra de um ciclista, decidindo se houve quebra e marcando
  * a flag apropriada.
  */
-void decidir_se_ciclista_quebrou(ciclista_t* ciclista) {
-    int quebra, i;
+void decidir_se_ciclista_quebrou(simulacao_t* simulacao, ciclista_t* ciclista) {
+    int quebra;
+
+    /**
+     * Um ciclista que acabou de ser eliminado já saiu da contagem de restantes.
+     */
+    if (ciclista->eliminado) return;
 
-    if (ciclista->volta_atual % 6 == 0 && simulacao->ciclistas_restantes > 5) {
-        quebra = rand() % 100;
+    if (ciclista->volta_atual % 6 == 0 && restantes_na_corrida(simulacao) > 5) {
+        quebra = prng_sortear(&ciclista->prng, 100);
 
         if (quebra > 95) {
             ciclista->quebrado = TRUE;
-            fprintf(stderr, "%d quebrou na volta %d\n", ciclista->id, ciclista->volta_atual);
-            for(i=ciclista->volta_atual-1; simulacao->ranking_voltas[i]->ciclistas_restantes;i++){
-              simulacao->ranking_voltas[i]->ciclistas_restantes--;
+            registrar_saida(simulacao, ciclista);
+            if (simulacao->saida != NULL) {
+                fprintf(simulacao->saida, "%d quebrou na volta %d\n", ciclista->id, ciclista->volta_atual);
             }
-            simulacao->ciclistas_restantes--;
+            descontar_ciclista(simulacao, ciclista);
+            fechar_voltas(simulacao);
         }
     }
 }
@@ -246,133 +340,157 @@ void decidir_se_ciclista_quebrou(ciclista_t* ciclista) {
 /**
  * Remove um ciclista da pista e registra o momento em que ele finalizou a prova.
  */
-void remover_ciclista(ciclista_t* ciclista) {
-    posicao_t* posicao;
+void remover_ciclista(simulacao_t* simulacao, ciclista_t* ciclista) {
+    travar(simulacao, &simulacao->mutex_ciclistas, TRAVA_CICLISTAS);
 
-    posicao = simulacao->pista[ciclista->i][ciclista->j];
+    desocupar(simulacao, ciclista->i, ciclista->j);
 
-    pthread_mutex_lock(&simulacao->mutex_ciclistas);
-    pthread_mutex_lock(&posicao->mutex);
+    pthread_mutex_unlock(&simulacao->mutex_ciclistas);
+}
 
-    posicao->ciclista = NULL;
 
-    pthread_mutex_unlock(&simulacao->mutex_ciclistas);
-    pthread_mutex_unlock(&posicao->mutex);
+/**
+ * Quantos lugares a lista de uma volta precisa. Quem ainda vai reservar um lugar nela
+ * ou já está contado nas pendentes da volta – inclusive quem já a cruzou e ainda não
+ * fez a soma atômica –, ou ainda vai entrar nela, e então está na corrida agora. Os
+ * três contadores são lidos nessa ordem para que ninguém escape entre uma leitura e
+ * outra: quem entrar na volta depois da primeira leitura estava na corrida nela.
+ */
+int capacidade_da_volta(simulacao_t* simulacao, ranking_t* ranking) {
+    int capacidade;
+
+    capacidade = __atomic_load_n(&simulacao->ciclistas_restantes, __ATOMIC_SEQ_CST);
+    capacidade += __atomic_load_n(&ranking->pendentes, __ATOMIC_SEQ_CST);
+    capacidade += __atomic_load_n(&ranking->ciclistas_registrados, __ATOMIC_SEQ_CST);
+
+    return capacidade < simulacao->n ? capacidade : simulacao->n;
+}
+
+
+/**
+ * Lista de lugares de uma volta, alocada por quem a registra primeiro, com espaço só
+ * para os ciclistas que ainda podem cruzá-la. Se dois ciclistas chegarem juntos, fica
+ * a lista de quem a publicar antes.
+ */
+ciclista_t** lista_da_volta(simulacao_t* simulacao, ranking_t* ranking) {
+    ciclista_t **lista, **nova;
+
+    lista = __atomic_load_n(&ranking->ciclistas, __ATOMIC_ACQUIRE);
+    if (lista != NULL) return lista;
+
+    nova = (ciclista_t**) malloc(capacidade_da_volta(simulacao, ranking) * sizeof(ciclista_t*));
+    if (__atomic_compare_exchange_n(&ranking->ciclistas, &lista, nova, FALSE,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return nova;
+    }
+    free(nova);
+    return lista;
 }
 
 
 /**
  * A cada vez que um ciclista mudar de volta, essa função verifica se é necessário
  * registrar a posição dele no ranking daquela volta em particular.
+ *
+ * Nenhuma trava é tomada. O ciclista passa para a volta seguinte trocando
+ * atomicamente sua volta_pendente – o que falha se ele acabou de sair da corrida –,
+ * reserva seu lugar na lista com uma soma atômica e só depois de escrever nele deixa
+ * de contar como pendente na volta que cruzou. Assim, quando as pendentes de uma volta
+ * zeram, todos os lugares dela já estão escritos, e quem as zerou a fecha.
  */
-void registrar_ranking(ciclista_t* ciclista) {
-    int num_eliminacao;
-    int ciclistas_atrasados;
-    int i;
+void registrar_ranking(simulacao_t* simulacao, ciclista_t* ciclista) {
+    int volta, lugar;
     ranking_t *ranking;
+    lideranca_t lideranca, atual;
+
+    volta = __atomic_load_n(&ciclista->volta_pendente, __ATOMIC_ACQUIRE);
 
     /**
      * Não deve haver registro de ranking caso o ciclista continue rodando por estar
-     * aguardando que outro ciclista mais lento finalize suas voltas.
+     * aguardando que outro ciclista mais lento finalize suas voltas, nem para quem já
+     * saiu da corrida.
      */
-    if (ciclista->volta_atual >= 2*simulacao->n) return;
-
-    num_eliminacao = ciclista->volta_atual - 1;
-    ranking = simulacao->ranking_voltas[num_eliminacao];
+    if (volta == SAIU || volta >= 2*simulacao->n) return;
+    if (!__atomic_compare_exchange_n(&ciclista->volta_pendente, &volta, volta + 1, FALSE,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return;
+    }
 
+    ranking = simulacao->ranking_voltas[volta];
+    lugar = __atomic_fetch_add(&ranking->ciclistas_registrados, 1, __ATOMIC_ACQ_REL);
+    lista_da_volta(simulacao, ranking)[lugar] = ciclista;
 
-    /*
-     * Mostra quantos ciclistas ainda estao competindo na volta atual.
+    /**
+     * O primeiro a cruzar a volta mais adiantada até aqui é o líder da corrida. Ele
+     * não é necessariamente o vencedor, que é o último a deixar a corrida. Quem abre
+     * voltas diferentes pode chegar aqui ao mesmo tempo, e só a volta maior fica.
      */
-    if(!ranking->ciclistas_registrados){
-      if(num_eliminacao==0){
-        ranking->ciclistas_restantes=simulacao->ciclistas_restantes;
-      }
-      simulacao->ranking_voltas[num_eliminacao+1]->ciclistas_restantes=simulacao->ciclistas_restantes;
-    }
-
-    pthread_mutex_lock(&ranking->mutex);
-
-    ranking->ciclistas[ranking->ciclistas_registrados] = ciclista;
-    // printf("%d \t %dth\n", ciclista->id, ranking->ciclistas_registrados);
-    ranking->ciclistas_registrados++;
-
-    if(num_eliminacao%2==1){
-      /*
-       * Checa se a eliminacao da penultima volta foi feita ou se o ultimo colocado daquela
-       * volta ainda não foi eliminado.
-       */
-      /*ciclistas_atrasados=0;
-      for(i=num_eliminacao-2; i>0 && !simulacao->ranking_voltas[i]->ciclista_eliminado; i-=2){
-        ciclistas_atrasados++;
-      }*/
-      /*
-       * Elimina o ultimo ciclista e sinaliza que essa volta ja eliminou o ultimo colocado dela.
-       */
-      if(ranking->ciclistas_registrados==ranking->ciclistas_restantes /*- ciclistas_atrasados*/){
-        ciclista->eliminado=1;
-        ranking->ciclista_eliminado=1;
-        for(i=ciclista->volta_atual; simulacao->ranking_voltas[i]->ciclistas_restantes;i++){
-          simulacao->ranking_voltas[i]->ciclistas_restantes--;
-        }
-        simulacao->ciclistas_restantes--;
-      }
+    if (lugar == 0) {
+        lideranca.lider = ciclista->id;
+        lideranca.volta = volta;
+        __atomic_load(&simulacao->lideranca, &atual, __ATOMIC_ACQUIRE);
+        while (volta > atual.volta &&
+               !__atomic_compare_exchange(&simulacao->lideranca, &atual, &lideranca, FALSE,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
     }
 
-
-    pthread_mutex_unlock(&ranking->mutex);
+    __atomic_add_fetch(&simulacao->ranking_voltas[volta + 1]->pendentes, 1, __ATOMIC_ACQ_REL);
+    if (__atomic_sub_fetch(&ranking->pendentes, 1, __ATOMIC_ACQ_REL) <= 0) {
+        fechar_voltas(simulacao);
+    }
 }
 
 
 /**
- * Função que controla a movimentação de um ciclista ao longo da pista, orquestrando
- * inclusive os efeitos colaterais dessa ação – atualizar ranking, mudar velocidade, etc.
+ * Efeitos colaterais de um ciclista cruzar a linha de chegada: registra sua posição
+ * no ranking da volta, passa para a próxima volta e decide sua nova velocidade e
+ * se ele quebrou. É compartilhada por todos os motores de simulação.
  */
-void mover_ciclista(ciclista_t* ciclista) {
-    int prox_posicao_primeiro, mudou_volta;
-    posicao_t *prox_posicao, *posicao_atual;
+void completar_volta(simulacao_t* simulacao, ciclista_t* ciclista) {
+    registrar_ranking(simulacao, ciclista);
 
-    posicao_atual = simulacao->pista[ciclista->i][ciclista->j];
-    prox_posicao = proxima_posicao(ciclista);
+    ciclista->volta_atual++;
 
-    /**
-     * Define a ordem com que o código vai tentar atualizar as posições, com o objetivo
-     * de evitar o problema dos filósofos famintos.
-     */
-    prox_posicao_primeiro = rand() % 2;
+    mudar_velocidade(simulacao, ciclista);
+    decidir_se_ciclista_quebrou(simulacao, ciclista);
 
-    if (prox_posicao_primeiro) {
-        pthread_mutex_lock(&prox_posicao->mutex);
-        pthread_mutex_lock(&posicao_atual->mutex);
-    } else {
-        pthread_mutex_lock(&posicao_atual->mutex);
-        pthread_mutex_lock(&prox_posicao->mutex);
-    }
+    imprimir_rankings(simulacao, FALSE);
 
-    mudou_volta = (prox_posicao->i == 0 && posicao_atual->i == simulacao->d - 1) ? TRUE : FALSE;
+    // debug("%d => volta %d!\n", ciclista->id, ciclista->volta_atual);
+}
 
-    if (prox_posicao->ciclista == NULL) {
-        prox_posicao->ciclista = ciclista;
-        posicao_atual->ciclista = NULL;
-        ciclista->i = prox_posicao->i;
-        ciclista->j = prox_posicao->j;
-    }
 
-    /**
-     * Libera o acesso às posições atualizadas.
-     */
-    pthread_mutex_unlock(&prox_posicao->mutex);
-    pthread_mutex_unlock(&posicao_atual->mutex);
+/**
+ * Função que controla a movimentação de um ciclista ao longo da pista, orquestrando
+ * inclusive os efeitos colaterais dessa ação – atualizar ranking, mudar velocidade, etc.
+ *
+ * Nenhuma trava é usada: o ciclista só ocupa a próxima posição se conseguir trocá-la
+ * atomicamente de VAZIA para o seu id. Se outro ciclista chegar lá antes, ele fica
+ * parado nessa vez. Como a posição atual só é escrita pelo próprio ciclista, basta
+ * esvaziá-la depois de ocupar a próxima.
+ */
+void mover_ciclista(simulacao_t* simulacao, ciclista_t* ciclista) {
+    int mudou_volta;
+    int prox_i, prox_j;
 
-    if (mudou_volta) {
-        registrar_ranking(ciclista);
+    if (!proxima_posicao(simulacao, ciclista->i, ciclista->j, &prox_i, &prox_j)) {
+        if (simulacao->contencao) contar_bloqueio(simulacao, ciclista->i, ciclista->j);
+        return;
+    }
 
-        ciclista->volta_atual++;
+    if (!ocupar(simulacao, prox_i, prox_j, ciclista->id)) {
+        if (simulacao->contencao) contar_disputa(simulacao, prox_i, prox_j);
+        return;
+    }
+
+    desocupar(simulacao, ciclista->i, ciclista->j);
 
-        mudar_velocidade(ciclista);
-        decidir_se_ciclista_quebrou(ciclista);
+    mudou_volta = (prox_i == 0 && ciclista->i == simulacao->d - 1) ? TRUE : FALSE;
+    ciclista->i = prox_i;
+    ciclista->j = prox_j;
 
-        // debug("%d => volta %d!\n", ciclista->id, ciclista->volta_atual);
+    if (mudou_volta) {
+        completar_volta(simulacao, ciclista);
     }
 }
 
@@ -383,6 +501,7 @@ void mover_ciclista(ciclista_t* ciclista) {
  */
 void* simular_ciclista(void* args) {
     ciclista_t* ciclista = (ciclista_t*) args;
+    simulacao_t* simulacao = ciclista->simulacao;
     int tempo_gasto, tempo_espera;
 
     /**
@@ -397,13 +516,13 @@ void* simular_ciclista(void* args) {
     while (!(ciclista->quebrado || ciclista->eliminado)) {
         tempo_espera = intervalo(ciclista);
 
-        mover_ciclista(ciclista);
+        mover_ciclista(simulacao, ciclista);
 
         usleep(tempo_espera);
         tempo_gasto += tempo_espera;
     }
 
-    remover_ciclista(ciclista);
+    remover_ciclista(simulacao, ciclista);
     ciclista->tempo_gasto = tempo_gasto / INTERVAL_1MS;
 
     return NULL;
@@ -412,9 +531,10 @@ void* simular_ciclista(void* args) {
 
 /**
  * Inicializa um ciclista de acordo com as especificações de como eles deveriam estar
- * no começo da primeira volta: a 30km/h e não-ciclistas.
+ * no começo da primeira volta: a 30km/h e não-ciclistas. A thread que o simula só é
+ * criada pelo motor com threads, depois que todos estiverem na largada.
  */
-ciclista_t* init_ciclista(int id, int i, int j) {
+ciclista_t* init_ciclista(simulacao_t* simulacao, int id, int i, int j) {
     ciclista_t* ciclista;
 
     ciclista = (ciclista_t*) malloc(sizeof(ciclista_t));
@@ -422,72 +542,92 @@ ciclista_t* init_ciclista(int id, int i, int j) {
     ciclista->id = id;
     ciclista->eliminado = 0;
     ciclista->quebrado = FALSE;
-    ciclista->velocidade = 30;
+    ciclista->velocidade = simulacao->modelo->inicial;
     ciclista->i = i;
     ciclista->j = j;
     ciclista->volta_atual = 1;
+    ciclista->volta_pendente = 0;
+    ciclista->tempo_gasto = 0;
+    ciclista->simulacao = simulacao;
 
-    pthread_create(&ciclista->thread, NULL, simular_ciclista, ciclista);
+    /**
+     * O fluxo 0 é o do sorteio da largada; cada ciclista usa o seu próprio.
+     */
+    prng_semear(&ciclista->prng, simulacao->semente, id + 1);
 
     return ciclista;
 }
 
 
-/**
- * Inicializa uma posição vazia da pista, incluindo o mutex que controla o
- * seu acesso.
- */
-posicao_t* init_posicao(int i, int j) {
-    posicao_t* posicao;
-
-    posicao = malloc(sizeof(posicao_t));
-    posicao->ciclista = NULL;
-    posicao->i = i;
-    posicao->j = j;
-    pthread_mutex_init(&posicao->mutex, NULL);
-
-    return posicao;
-}
-
-
 /**
  * Inicializa o vetor de rankings usado para registrar a colocação de cada ciclista nas
- * voltas de eliminação.
+ * voltas de eliminação. Além das voltas em si, há um ranking extra ao final, onde
+ * ficam pendentes os que já cruzaram a última. Na largada, todos estão pendentes na
+ * primeira volta.
  */
 ranking_t** init_rankings(int n, int voltas) {
     int i;
     ranking_t** rankings;
 
-    rankings = (ranking_t**) malloc(voltas * sizeof(ranking_t*));
-    for (i = 0; i < voltas; i++) {
+    rankings = (ranking_t**) malloc((voltas + 1) * sizeof(ranking_t*));
+    for (i = 0; i <= voltas; i++) {
         rankings[i] = (ranking_t*) malloc(sizeof(ranking_t));
-        rankings[i]->ciclistas = (ciclista_t**) malloc(n * sizeof(ranking_t*));
+        rankings[i]->ciclistas = NULL;
+        rankings[i]->concluida = FALSE;
         rankings[i]->ciclistas_registrados = 0;
+        rankings[i]->pendentes = 0;
         rankings[i]->ciclista_eliminado=0;
-        pthread_mutex_init(&rankings[i]->mutex, NULL);
     }
+    rankings[0]->pendentes = n;
 
     return rankings;
 }
 
 
 /**
- * Aloca o espaço necessário para o vetor de pista, incluindo o vetor auxiliar de
- * cada posição responsável por armazenar os ciclistas ali presentes naquele momento.
+ * Aloca, num único bloco alinhado a linhas de cache, as d × faixas posições da
+ * pista, todas vazias.
  */
-posicao_t*** init_pista(int d) {
-    int i, j;
-    posicao_t*** pista;
+int* init_pista(int d, int faixas) {
+    void* pista;
+    int i, n_posicoes;
+
+    n_posicoes = d * faixas;
+    if (posix_memalign(&pista, TAM_LINHA_CACHE, n_posicoes * sizeof(int))) {
+        fprintf(stderr, "Não foi possível alocar uma pista com %d metros\n", d);
+        exit(1);
+    }
+    for (i = 0; i < n_posicoes; i++) {
+        ((int*) pista)[i] = VAZIA;
+    }
+
+    return (int*) pista;
+}
 
-    pista = (posicao_t***) malloc(d * sizeof(posicao_t**));
 
+/**
+ * Aloca as máscaras de ocupação da pista, todas as faixas livres. Os bits que
+ * sobram na última palavra de cada metro, além da última faixa, ficam marcados como
+ * ocupados para que nenhuma busca os devolva.
+ */
+uint64_t* init_ocupacao(int d, int faixas, int palavras) {
+    void* ocupacao;
+    int i, w;
+    uint64_t sobra;
+
+    if (posix_memalign(&ocupacao, TAM_LINHA_CACHE, (size_t) d * palavras * sizeof(uint64_t))) {
+        fprintf(stderr, "Não foi possível alocar uma pista com %d metros\n", d);
+        exit(1);
+    }
+
+    sobra = (faixas % BITS_POR_PALAVRA) ? ~UINT64_C(0) << (faixas % BITS_POR_PALAVRA) : 0;
     for (i = 0; i < d; i++) {
-        pista[i] = (posicao_t**) malloc(MAX_CICLISTAS * sizeof(posicao_t*));
-        for (j = 0; j < MAX_CICLISTAS; j++) {
-            pista[i][j] = init_posicao(i, j);
+        for (w = 0; w < palavras; w++) {
+            ((uint64_t*) ocupacao)[(long) i * palavras + w] = (w == palavras - 1) ? sobra : 0;
         }
     }
-    return pista;
+
+    return (uint64_t*) ocupacao;
 }
 
 
@@ -495,20 +635,45 @@ posicao_t*** init_pista(int d) {
  * Inicializa a simulação, definindo os parâmetros globais que devem coordenar os
  * ciclistas.
  */
-simulacao_t* init_simulacao(int d, int n) {
+simulacao_t* init_simulacao(int d, int n, int faixas, int largada, unsigned long semente) {
     int i;
     simulacao_t* sim;
 
     sim = (simulacao_t*) malloc(sizeof(simulacao_t));
 
-    sim->pista = init_pista(d);
+    sim->pista = init_pista(d, faixas);
+    sim->faixas = faixas;
+    sim->palavras_por_metro = (faixas + BITS_POR_PALAVRA - 1) / BITS_POR_PALAVRA;
+    sim->ocupacao = init_ocupacao(d, faixas, sim->palavras_por_metro);
+    sim->largada = largada;
     sim->d = d;
     sim->n = n;
     sim->ciclistas_restantes = n;
+    sim->semente = semente;
+    prng_semear(&sim->prng, semente, 0);
     sim->ciclistas = (ciclista_t**) malloc(n * sizeof(ciclista_t*));
     sim->ranking_voltas = init_rankings(n, 2*n);
+    sim->volta_aberta = 0;
+    sim->proximo_ranking = 0;
+    sim->saida = stderr;
+    sim->trajetoria = NULL;
+    sim->contencao = NULL;
+    sim->painel = NULL;
+    sim->depurar = FALSE;
+    sim->ordem_de_saida = (int*) malloc(n * sizeof(int));
+    sim->n_fora = 0;
+    sim->ultimo_ranking = (int*) malloc(n * sizeof(int));
+    sim->tam_ultimo_ranking = 0;
+    sim->volta_ultimo_ranking = -1;
+    sim->ha_ciclista_a_90 = 0;
+    sim->modelo = modelo_padrao();
+    sim->lideranca.lider = -1;
+    sim->lideranca.volta = -1;
+    pthread_mutex_init(&sim->mutex_rankings, NULL);
 
     pthread_mutex_init(&sim->mutex_ciclistas, NULL);
+    pthread_mutex_init(&sim->mutex_fim, NULL);
+    pthread_cond_init(&sim->fim_da_corrida, NULL);
 
     for (i = 0; i < n; i++) {
         sim->ciclistas[i] = NULL;
@@ -522,32 +687,27 @@ simulacao_t* init_simulacao(int d, int n) {
  * Percorre todas as posições de memória alocadas dinamicamente e as libera.
  */
 void free_simulacao(simulacao_t* simulacao) {
-    int i, j, d, n;
-    posicao_t*** pista;
+    int i, n;
 
-    pista = simulacao->pista;
-    d = simulacao->d;
     n = simulacao->n;
 
-    for (i = 0; i < d; i++) {
-        for (j = 0; j < MAX_CICLISTAS; j++) {
-            if (pista[i][j]->ciclista != NULL) {   // remover quando o ep estiver pronto, pq no final não vai haver ciclista na pista
-                free(pista[i][j]->ciclista);
-            }
-            pthread_mutex_destroy(&pista[i][j]->mutex);
-            free(pista[i][j]);
-        }
-        free(pista[i]);
-    }
     for (i = 0; i < n; i++) {
-        pthread_mutex_destroy(&simulacao->ranking_voltas[i]->mutex);
+        free(simulacao->ciclistas[i]);
+    }
+    for (i = 0; i <= 2*n; i++) {
         free(simulacao->ranking_voltas[i]->ciclistas);
         free(simulacao->ranking_voltas[i]);
     }
     pthread_mutex_destroy(&simulacao->mutex_ciclistas);
+    pthread_mutex_destroy(&simulacao->mutex_fim);
+    pthread_mutex_destroy(&simulacao->mutex_rankings);
+    pthread_cond_destroy(&simulacao->fim_da_corrida);
     free(simulacao->pista);
+    free(simulacao->ocupacao);
     free(simulacao->ciclistas);
     free(simulacao->ranking_voltas);
+    free(simulacao->ordem_de_saida);
+    free(simulacao->ultimo_ranking);
     free(simulacao);
 }
 
@@ -557,7 +717,7 @@ void free_simulacao(simulacao_t* simulacao) {
  * alguma das posições iniciais da pista. Note que cada ciclista aqui é identificado
  * por um inteiro entre 0 e n-1 (inclusive).
  */
-void dar_largada(posicao_t*** pista, int d, int n) {
+void dar_largada(simulacao_t* simulacao, int d, int n) {
     int i, j, id_ciclista, n_ciclistas;
     int* ids;
     ciclista_t* ciclista;
@@ -569,15 +729,15 @@ void dar_largada(posicao_t*** pista, int d, int n) {
      * Define quantas posições do vetor de pista vão ser necessárias para acomodar
      * o número de ciclistas na largada.
      */
-    if (n % MAX_CICLISTAS_LARGADA) {
-        i = ceil(n / MAX_CICLISTAS_LARGADA);
+    if (n % simulacao->largada) {
+        i = ceil(n / simulacao->largada);
     } else {
-        i = n / MAX_CICLISTAS_LARGADA - 1;
+        i = n / simulacao->largada - 1;
     }
 
     j = 0;
     while (n_ciclistas > 0) {
-        id_ciclista = rand() % n;
+        id_ciclista = prng_sortear(&simulacao->prng, n);
 
         /**
          * Se um ciclista com o ID sorteado ainda não foi colocado na corrida,
@@ -585,9 +745,9 @@ void dar_largada(posicao_t*** pista, int d, int n) {
          */
         if (!ids[id_ciclista]) {
             ids[id_ciclista] = TRUE;
-            ciclista = init_ciclista(id_ciclista, i, j);
+            ciclista = init_ciclista(simulacao, id_ciclista, i, j);
 
-            simulacao->pista[i][j]->ciclista = ciclista;
+            ocupar_sem_disputa(simulacao, i, j, ciclista->id);
             simulacao->ciclistas[n - n_ciclistas] = ciclista;
 
             n_ciclistas--;
@@ -596,7 +756,7 @@ void dar_largada(posicao_t*** pista, int d, int n) {
             /**
              * Se já colocamos o máximo de ciclistas nessa posição, vamos pra próxima.
              */
-            if (j == MAX_CICLISTAS_LARGADA) {
+            if (j == simulacao->largada) {
                 j = 0;
                 i--;
             }
@@ -606,50 +766,236 @@ void dar_largada(posicao_t*** pista, int d, int n) {
 }
 
 
+/**
+ * O que a thread principal faz enquanto uma corrida em tempo real acontece em outras
+ * threads. Sem depuração, ela só acorda quando a corrida termina. Com ela, acorda
+ * também a cada intervalo para desenhar a pista.
+ */
+void acompanhar_corrida(simulacao_t* simulacao) {
+    if (!simulacao->depurar) {
+        aguardar_fim_da_corrida(simulacao, 0);
+    } else {
+        while (!aguardar_fim_da_corrida(simulacao, simulacao->ha_ciclista_a_90 ? INTERVAL_60MS : INTERVAL_20MS)) {
+            desenhar_painel(simulacao);
+        }
+    }
+}
+
+
+/**
+ * Motor original: uma thread por ciclista, todas andando em tempo real. A thread
+ * principal apenas acompanha a corrida até que não haja mais ciclistas restantes.
+ */
+void simular_com_threads(simulacao_t* simulacao) {
+    int i;
+
+    for (i = 0; i < simulacao->n; i++) {
+        pthread_create(&simulacao->ciclistas[i]->thread, NULL, simular_ciclista,
+                       simulacao->ciclistas[i]);
+    }
+
+    acompanhar_corrida(simulacao);
+
+    /**
+     * Aguarda até que todas as threads tenha finalizado sua simulação.
+     */
+    for (i = 0; i < simulacao->n; i++) {
+        pthread_join(simulacao->ciclistas[i]->thread, NULL);
+    }
+}
+
+
 
 int main(int argc, char* argv[]) {
-    int n, d;
+    int n, d, faixas, largada, motor, n_workers, corridas, i;
+    unsigned long semente;
+    char *trajetoria, *salvar, *restaurar, *velocidades;
+    int contencao, janela, depurar, na_volta;
+    simulacao_t* simulacao;
+    passos_t* passos;
+    modelo_t* modelo;
 
     if (argc < 3) {
-        fprintf(stderr, "Uso: ./ep2 <d> <n> [debug]\n");
+        fprintf(stderr, "Uso: ./ep2 <d> <n> [debug] [--motor=threads|tarefas|passos|ticks|segmentos|eventos] [--workers=N] [--faixas=N] [--largada=N] [--seed=N] [--lote=N] [--trajetoria=arquivo] [--contencao] [--janela=N] [--salvar=arquivo --na-volta=V] [--restaurar=arquivo] [--velocidades=arquivo]\n");
         return 1;
     }
     d = atoi(argv[1]);
     n = atoi(argv[2]);
-    DEBUG = (argc == 4) ? 1 : 0;
+    motor = 0;
+    corridas = 0;
+    trajetoria = NULL;
+    salvar = restaurar = velocidades = NULL;
+    na_volta = 0;
+    passos = NULL;
+    contencao = FALSE;
+    janela = JANELA_PADRAO;
+    depurar = FALSE;
+    semente = time(NULL);
+    n_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    faixas = FAIXAS_PADRAO;
+    largada = LARGADA_PADRAO;
 
-    ha_ciclista_a_90 = 0;
+    /**
+     * Qualquer argumento extra que não seja uma opção liga o modo de depuração.
+     */
+    for (i = 3; i < argc; i++) {
+        if (!strcmp(argv[i], "--motor=threads")) {
+            motor = MOTOR_THREADS;
+        } else if (!strcmp(argv[i], "--motor=tarefas")) {
+            motor = MOTOR_TAREFAS;
+        } else if (!strcmp(argv[i], "--motor=passos")) {
+            motor = MOTOR_PASSOS;
+        } else if (!strcmp(argv[i], "--motor=ticks")) {
+            motor = MOTOR_TICKS;
+        } else if (!strcmp(argv[i], "--motor=segmentos")) {
+            motor = MOTOR_SEGMENTOS;
+        } else if (!strcmp(argv[i], "--motor=eventos")) {
+            motor = MOTOR_EVENTOS;
+        } else if (!strncmp(argv[i], "--workers=", 10)) {
+            n_workers = atoi(argv[i] + 10);
+        } else if (!strncmp(argv[i], "--faixas=", 9)) {
+            faixas = atoi(argv[i] + 9);
+        } else if (!strncmp(argv[i], "--largada=", 10)) {
+            largada = atoi(argv[i] + 10);
+        } else if (!strncmp(argv[i], "--seed=", 7)) {
+            semente = strtoul(argv[i] + 7, NULL, 10);
+        } else if (!strncmp(argv[i], "--lote=", 7)) {
+            corridas = atoi(argv[i] + 7);
+        } else if (!strncmp(argv[i], "--trajetoria=", 13)) {
+            trajetoria = argv[i] + 13;
+        } else if (!strncmp(argv[i], "--janela=", 9)) {
+            janela = atoi(argv[i] + 9);
+        } else if (!strncmp(argv[i], "--salvar=", 9)) {
+            salvar = argv[i] + 9;
+        } else if (!strncmp(argv[i], "--na-volta=", 11)) {
+            na_volta = atoi(argv[i] + 11);
+        } else if (!strncmp(argv[i], "--restaurar=", 12)) {
+            restaurar = argv[i] + 12;
+        } else if (!strncmp(argv[i], "--velocidades=", 14)) {
+            velocidades = argv[i] + 14;
+        } else if (!strcmp(argv[i], "--contencao")) {
+            contencao = TRUE;
+        } else if (!strncmp(argv[i], "--", 2)) {
+            fprintf(stderr, "Opção desconhecida: %s\n", argv[i]);
+            return 1;
+        } else {
+            depurar = TRUE;
+        }
+    }
 
     /**
-     * Define a semente do gerador de números aleatórios.
+     * As filas da largada precisam caber na pista: largada ciclistas lado a lado, em
+     * tantos metros quantos forem necessários para acomodar todos.
      */
-    srand(time(NULL));
+    if (faixas < 1 || largada < 1 || largada > faixas) {
+        fprintf(stderr, "A largada precisa ter entre 1 e %d ciclistas por fila\n", faixas);
+        return 1;
+    }
+    if (d < (n + largada - 1) / largada) {
+        fprintf(stderr, "A pista é curta demais para alinhar %d ciclistas na largada\n", n);
+        return 1;
+    }
 
-    simulacao = init_simulacao(d, n);
-    dar_largada(simulacao->pista, d, n);
+    /**
+     * No modo em lote as corridas rodam lado a lado, uma por worker, então cada uma
+     * precisa de um motor que não crie suas próprias threads.
+     */
+    if (motor == 0) {
+        motor = (corridas > 0 || salvar != NULL || restaurar != NULL) ? MOTOR_PASSOS : MOTOR_THREADS;
+    }
+    if ((salvar != NULL || restaurar != NULL) && (motor != MOTOR_PASSOS || corridas > 0)) {
+        fprintf(stderr, "Pontos de restauração só existem para uma corrida no motor de passos\n");
+        return 1;
+    }
+    if (salvar != NULL && na_volta < 1) {
+        fprintf(stderr, "--salvar precisa de --na-volta=V, com V a partir de 1\n");
+        return 1;
+    }
+    if (trajetoria != NULL && (motor == MOTOR_THREADS || motor == MOTOR_TAREFAS ||
+                               motor == MOTOR_SEGMENTOS || corridas > 0)) {
+        fprintf(stderr, "Só uma corrida com os motores de passos, ticks ou eventos pode ser gravada\n");
+        return 1;
+    }
+    modelo = velocidades != NULL ? carregar_modelo(velocidades) : modelo_padrao();
+    if (modelo == NULL) return 1;
 
-    while (simulacao->ciclistas_restantes > 0) {
-        if (DEBUG) {
-            print_pista();
+    if (contencao && corridas > 0) {
+        fprintf(stderr, "O modo em lote não aceita --contencao\n");
+        return 1;
+    }
+    if (corridas > 0) {
+        if (motor == MOTOR_THREADS || motor == MOTOR_TAREFAS) {
+            fprintf(stderr, "O modo em lote não aceita os motores em tempo real\n");
+            return 1;
         }
+        simular_lote_em_paralelo(d, n, faixas, largada, motor, corridas, semente, n_workers,
+                                 modelo, depurar, stdout);
+        return 0;
+    }
 
-        if (!ha_ciclista_a_90){
-          usleep(INTERVAL_20MS);
-        } else {
-          usleep(INTERVAL_60MS);
-        }
+    /**
+     * Uma corrida restaurada traz seus próprios d, n, faixas, largada e semente; os da
+     * linha de comando não são usados. O modelo de velocidades precisa ser o mesmo com
+     * que ela foi gravada.
+     */
+    if (restaurar != NULL) {
+        simulacao = restaurar_simulacao(restaurar, modelo, &passos);
+        if (simulacao == NULL) return 1;
+        simulacao->depurar = depurar;
+        debug("Restaurada de %s com o líder na volta %d\n", restaurar, simulacao->lideranca.volta + 1);
+    } else {
+        simulacao = init_simulacao(d, n, faixas, largada, semente);
+        simulacao->modelo = modelo;
+        simulacao->depurar = depurar;
+        debug("Semente: %lu\n", semente);
+        dar_largada(simulacao, d, n);
     }
-    for (int i = 0; i < 2*n && simulacao->ranking_voltas[i]!= NULL &&
-         simulacao->ranking_voltas[i]->ciclistas_registrados; i++) {
-        print_ranking(i);
+
+    if (trajetoria != NULL) {
+        simulacao->trajetoria = init_trajetoria(simulacao, trajetoria);
+        if (simulacao->trajetoria == NULL) return 1;
+    }
+    if (contencao) {
+        simulacao->contencao = init_contencao(simulacao);
+    }
+    if (depurar && motor != MOTOR_EVENTOS) {
+        simulacao->painel = init_painel(simulacao, janela);
+    }
+
+    if (motor == MOTOR_PASSOS) {
+        if (passos == NULL) passos = init_passos(simulacao);
+        if (salvar != NULL && !salvar_na_volta(simulacao, passos, salvar, na_volta)) return 1;
+        continuar_em_passos(simulacao, passos);
+    } else if (motor == MOTOR_TICKS) {
+        simular_em_ticks(simulacao, n_workers);
+    } else if (motor == MOTOR_EVENTOS) {
+        simular_em_eventos(simulacao);
+    } else if (motor == MOTOR_SEGMENTOS) {
+        simular_em_segmentos(simulacao, n_workers);
+    } else if (motor == MOTOR_TAREFAS) {
+        simular_em_tarefas(simulacao, n_workers);
+    } else {
+        simular_com_threads(simulacao);
+    }
+
+    if (simulacao->painel != NULL) {
+        free_painel(simulacao->painel);
+    }
+
+    if (simulacao->trajetoria != NULL && !fechar_trajetoria(simulacao->trajetoria)) {
+        return 1;
     }
-    // print_ciclistas();
 
     /**
-     * Aguarda até que todas as threads tenha finalizado sua simulação.
+     * Os rankings das voltas concluídas já foram impressos durante a corrida; faltam
+     * as que terminaram incompletas.
      */
-    for (int i = 0; i < n; i++) {
-        pthread_join(simulacao->ciclistas[i]->thread, NULL);
+    imprimir_rankings(simulacao, TRUE);
+    // print_ciclistas(simulacao);
+
+    if (simulacao->contencao != NULL) {
+        imprimir_contencao(simulacao, stderr);
+        free_contencao(simulacao->contencao);
     }
 
     free_simulacao(simulacao);
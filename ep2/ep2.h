@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <pthread.h>
+#include "prng.h"
+
+#define debug(...) if (simulacao->depurar) { fprintf(stderr, __VA_ARGS__); }
+
+#define FAIXAS_PADRAO 10
+#define LARGADA_PADRAO 5
+#define FALSE 0
+#define TRUE 1
+#define INTERVAL_120MS 120000
+#define INTERVAL_60MS  60000
+#define INTERVAL_40MS  40000
+#define INTERVAL_20MS  20000
+#define INTERVAL_1MS   1000
+
+/**
+ * Duração de um passo do motor de passos – múltiplo comum de todos os
+ * intervalos entre movimentos.
+ */
+#define INTERVAL_PASSO INTERVAL_20MS
+
+/**
+ * Tamanho de uma linha de cache, usado para alinhar a pista.
+ */
+#define TAM_LINHA_CACHE 64
+
+/**
+ * Índice da posição (metro i, faixa j) no vetor contíguo que guarda a pista.
+ */
+#define POSICAO(i, j) ((i) * simulacao->faixas + (j))
+
+/**
+ * Cada metro da pista também tem uma máscara de ocupação com um bit por faixa,
+ * dividida em palavras de 64 bits. PALAVRA dá a palavra em que fica o bit da faixa j
+ * do metro i, e BIT, a posição dele dentro da palavra.
+ */
+#define BITS_POR_PALAVRA 64
+#define PALAVRA(i, j) ((i) * simulacao->palavras_por_metro + (unsigned) (j) / BITS_POR_PALAVRA)
+#define BIT(j) (UINT64_C(1) << ((unsigned) (j) % BITS_POR_PALAVRA))
+
+/**
+ * Conteúdo de uma posição da pista sem nenhum ciclista.
+ */
+#define VAZIA -1
+
+#define MOTOR_THREADS 1
+#define MOTOR_PASSOS  2
+#define MOTOR_TICKS   3
+#define MOTOR_EVENTOS 4
+#define MOTOR_TAREFAS 5
+#define MOTOR_SEGMENTOS 6
+
+/**
+ * Gravador da trajetória de uma corrida, definido em trajetoria.c.
+ */
+typedef struct info_trajetoria trajetoria_t;
+
+/**
+ * Contadores de disputa por travas e posições da pista, definidos em contencao.c.
+ * Cada trava da simulação pertence a uma classe, e as estatísticas são somadas por
+ * classe.
+ */
+typedef struct info_contencao contencao_t;
+
+/**
+ * Estado do motor de passos, definido em passos.c.
+ */
+typedef struct info_passos passos_t;
+
+/**
+ * Painel da pista do modo de depuração, definido em painel.c.
+ */
+typedef struct info_painel painel_t;
+
+/**
+ * Quantos metros o painel mostra quando --janela não é dado.
+ */
+#define JANELA_PADRAO 30
+
+/**
+ * Modelo de velocidades (velocidades.c): as velocidades possíveis, quanto tempo cada
+ * uma leva para percorrer um metro e, para cada regime e velocidade atual, a próxima
+ * velocidade de acordo com o sorteio feito a cada volta. Ciclistas e motores guardam
+ * a velocidade como um índice nessas tabelas.
+ */
+#define MAX_VELOCIDADES 16
+#define N_SORTEIOS      100     // valores possíveis do sorteio de cada volta
+#define REGIME_NORMAL   0
+#define REGIME_FINAL    1       // restam restantes_final ciclistas e ninguém chegou a uma velocidade encerra_final
+#define N_REGIMES       2
+
+typedef struct info_modelo {
+    int n_velocidades;
+    int velocidades[MAX_VELOCIDADES];       // em km/h
+    int passos[MAX_VELOCIDADES];            // passos de INTERVAL_PASSO para percorrer um metro
+    int intervalos[MAX_VELOCIDADES];        // o mesmo, em microssegundos
+    int encerra_final[MAX_VELOCIDADES];
+    int max_passos;
+    int inicial;                            // velocidade da largada
+    int restantes_final;                    // 0 se não houver regime final
+    unsigned char proxima[N_REGIMES][MAX_VELOCIDADES][N_SORTEIOS];
+} modelo_t;
+
+#define TRAVA_CICLISTAS 0   // mutex_ciclistas
+#define TRAVA_RANKINGS  1   // mutex_rankings
+#define TRAVA_FIM       2   // mutex_fim
+#define N_TRAVAS        3
+#define N_FAIXAS_ESPERA 40
+
+typedef struct info_ciclista {
+    int id;
+    int velocidade;             // índice em simulacao->modelo
+    int eliminado;
+    int quebrado;
+    int i;
+    int j;
+    int volta_atual;
+    int volta_pendente;         // índice da próxima volta que ele registrará, ou SAIU
+    double tempo_gasto;
+    prng_t prng;
+    pthread_t thread;
+    struct info_simulacao* simulacao;   // corrida da qual o ciclista participa
+} ciclista_t;
+
+/**
+ * volta_pendente de quem já saiu da corrida.
+ */
+#define SAIU -1
+
+typedef struct info_ranking {
+    int ciclistas_registrados;  // lugares já reservados na lista, em ordem de chegada
+    int ciclista_eliminado;
+    int pendentes;              // ciclistas na corrida cuja volta_pendente é esta
+    int concluida;              // todos os ciclistas ainda na corrida já cruzaram a volta
+    ciclista_t** ciclistas;     // lugares para quem ainda pode cruzá-la, só enquanto a volta está em andamento
+} ranking_t;
+
+/**
+ * Quem lidera a corrida e em que volta. Os dois ficam numa mesma palavra para que
+ * registrar_ranking troque os dois juntos, com um único compare-and-swap.
+ */
+typedef struct info_lideranca {
+    int lider;                  // id do primeiro a cruzar a volta mais adiantada
+    int volta;
+} __attribute__((aligned(8))) lideranca_t;
+
+typedef struct info_simulacao {
+    int d;
+    int n;
+    int faixas;                 // largura da pista
+    int largada;                // ciclistas lado a lado em cada fila da largada
+    int ciclistas_restantes;
+    int ha_ciclista_a_90;       // alguém já alcançou uma velocidade que encerra o regime final
+    modelo_t* modelo;           // compartilhado, só lido durante a corrida
+    lideranca_t lideranca;
+    int* pista;                 // id do ocupante de cada uma das d × faixas posições
+    uint64_t* ocupacao;         // máscara de faixas ocupadas, metro a metro
+    int palavras_por_metro;
+    ciclista_t** ciclistas;
+    ranking_t** ranking_voltas;
+    int volta_aberta;           // primeira volta ainda não fechada
+    int proximo_ranking;        // primeira volta cujo ranking ainda não foi impresso
+    FILE* saida;                // rankings e avisos da corrida; NULL os descarta
+    trajetoria_t* trajetoria;   // NULL quando a corrida não é gravada
+    contencao_t* contencao;     // NULL quando a disputa por travas não é medida
+    painel_t* painel;           // NULL fora do modo de depuração
+    int depurar;                // modo de depuração desta corrida
+    int* ordem_de_saida;        // ids na ordem em que deixaram a corrida
+    int n_fora;
+    int* ultimo_ranking;        // ids da última volta cujo ranking foi publicado
+    int tam_ultimo_ranking;
+    int volta_ultimo_ranking;   // -1 antes da primeira
+    pthread_mutex_t mutex_rankings;
+    pthread_mutex_t mutex_ciclistas;
+    pthread_mutex_t mutex_fim;
+    pthread_cond_t fim_da_corrida;  // sinalizada quando ciclistas_restantes chega a zero
+    unsigned long semente;
+    prng_t prng;                // usado apenas no sorteio da largada
+} simulacao_t;
+
+
+/**
+ * Quantos ciclistas ainda estão na corrida. O contador é decrementado por várias
+ * threads, então toda leitura também é atômica.
+ */
+static inline int restantes_na_corrida(simulacao_t* simulacao) {
+    return __atomic_load_n(&simulacao->ciclistas_restantes, __ATOMIC_ACQUIRE);
+}
+
+
+void travar_medindo(contencao_t* contencao, pthread_mutex_t* mutex, int classe);
+
+/**
+ * Trava um mutex da simulação. Sem --contencao, é só um pthread_mutex_lock depois de
+ * um desvio que nunca é tomado.
+ */
+static inline void travar(simulacao_t* simulacao, pthread_mutex_t* mutex, int classe) {
+    if (simulacao->contencao == NULL) {
+        pthread_mutex_lock(mutex);
+    } else {
+        travar_medindo(simulacao->contencao, mutex, classe);
+    }
+}
+
+
+/**
+ * Acesso às posições da pista. Quem decide se uma posição está ocupada é o bit dela
+ * na máscara do metro: ocupar só dá certo se o bit ainda estiver livre no momento da
+ * troca atômica, o que dispensa travas mesmo com vários ciclistas disputando o mesmo
+ * lugar. O id guardado na pista serve para saber quem está ali.
+ */
+static inline int ocupante(simulacao_t* simulacao, int i, int j) {
+    return __atomic_load_n(&simulacao->pista[POSICAO(i, j)], __ATOMIC_ACQUIRE);
+}
+
+static inline int ocupar(simulacao_t* simulacao, int i, int j, int id) {
+    uint64_t* palavra = &simulacao->ocupacao[PALAVRA(i, j)];
+    uint64_t atual = __atomic_load_n(palavra, __ATOMIC_RELAXED);
+
+    do {
+        if (atual & BIT(j)) return FALSE;
+    } while (!__atomic_compare_exchange_n(palavra, &atual, atual | BIT(j), TRUE,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    __atomic_store_n(&simulacao->pista[POSICAO(i, j)], id, __ATOMIC_RELEASE);
+    return TRUE;
+}
+
+static inline void desocupar(simulacao_t* simulacao, int i, int j) {
+    __atomic_store_n(&simulacao->pista[POSICAO(i, j)], VAZIA, __ATOMIC_RELEASE);
+    __atomic_fetch_and(&simulacao->ocupacao[PALAVRA(i, j)], ~BIT(j), __ATOMIC_RELEASE);
+}
+
+/**
+ * Versões sem operações atômicas, para quando só uma thread mexe na pista – a
+ * largada e os motores de passos e de eventos.
+ */
+static inline void ocupar_sem_disputa(simulacao_t* simulacao, int i, int j, int id) {
+    simulacao->pista[POSICAO(i, j)] = id;
+    simulacao->ocupacao[PALAVRA(i, j)] |= BIT(j);
+}
+
+static inline void desocupar_sem_disputa(simulacao_t* simulacao, int i, int j) {
+    simulacao->pista[POSICAO(i, j)] = VAZIA;
+    simulacao->ocupacao[PALAVRA(i, j)] &= ~BIT(j);
+}
+
+
+/* ep2.c */
+void print_ranking(simulacao_t* simulacao, int volta);
+void imprimir_rankings(simulacao_t* simulacao, int pendentes);
+int intervalo(ciclista_t* ciclista);
+int primeira_faixa_livre(simulacao_t* simulacao, int i, int j);
+int proxima_posicao(simulacao_t* simulacao, int i, int j, int* prox_i, int* prox_j);
+void fechar_voltas(simulacao_t* simulacao);
+int capacidade_da_volta(simulacao_t* simulacao, ranking_t* ranking);
+void descontar_ciclista(simulacao_t* simulacao, ciclista_t* ciclista);
+int aguardar_fim_da_corrida(simulacao_t* simulacao, int timeout);
+void acompanhar_corrida(simulacao_t* simulacao);
+void registrar_saida(simulacao_t* simulacao, ciclista_t* ciclista);
+void eliminar_ciclista(simulacao_t* simulacao, ciclista_t* ciclista, int volta);
+void completar_volta(simulacao_t* simulacao, ciclista_t* ciclista);
+void mover_ciclista(simulacao_t* simulacao, ciclista_t* ciclista);
+void remover_ciclista(simulacao_t* simulacao, ciclista_t* ciclista);
+ciclista_t* init_ciclista(simulacao_t* simulacao, int id, int i, int j);
+simulacao_t* init_simulacao(int d, int n, int faixas, int largada, unsigned long semente);
+void free_simulacao(simulacao_t* simulacao);
+void dar_largada(simulacao_t* simulacao, int d, int n);
+
+/* tarefas.c */
+void simular_em_tarefas(simulacao_t* simulacao, int n_trabalhadores);
+
+/* passos.c */
+passos_t* init_passos(simulacao_t* simulacao);
+int avancar_passos(simulacao_t* simulacao, passos_t* passos, long max_passos);
+void encerrar_passos(simulacao_t* simulacao, passos_t* passos);
+void salvar_passos(passos_t* passos, FILE* arquivo);
+passos_t* restaurar_passos(simulacao_t* simulacao, FILE* arquivo);
+void continuar_em_passos(simulacao_t* simulacao, passos_t* passos);
+void simular_em_passos(simulacao_t* simulacao);
+
+/* ticks.c */
+void simular_em_ticks(simulacao_t* simulacao, int n_workers);
+
+/* segmentos.c */
+void simular_em_segmentos(simulacao_t* simulacao, int n_workers);
+
+/* eventos.c */
+void simular_em_eventos(simulacao_t* simulacao);
+
+/* salvamento.c */
+void gravar_numero(FILE* arquivo, int64_t valor);
+int64_t ler_numero(FILE* arquivo, int* ok);
+int salvar_simulacao(simulacao_t* simulacao, passos_t* passos, const char* caminho);
+simulacao_t* restaurar_simulacao(const char* caminho, modelo_t* modelo, passos_t** passos);
+int salvar_na_volta(simulacao_t* simulacao, passos_t* passos, const char* caminho, int volta);
+
+/* trajetoria.c */
+trajetoria_t* init_trajetoria(simulacao_t* simulacao, const char* caminho);
+void gravar_trajetoria(trajetoria_t* trajetoria, long tick, int k, int i, int j, int velocidade, int ativo);
+int fechar_trajetoria(trajetoria_t* trajetoria);
+
+/* contencao.c */
+contencao_t* init_contencao(simulacao_t* simulacao);
+void free_contencao(contencao_t* contencao);
+void contar_disputa(simulacao_t* simulacao, int i, int j);
+void contar_bloqueio(simulacao_t* simulacao, int i, int j);
+void imprimir_contencao(simulacao_t* simulacao, FILE* saida);
+
+/* painel.c */
+painel_t* init_painel(simulacao_t* simulacao, int janela);
+void free_painel(painel_t* painel);
+void desenhar_painel(simulacao_t* simulacao);
+
+/* velocidades.c */
+modelo_t* carregar_modelo(const char* caminho);
+modelo_t* modelo_padrao();
+
+/**
+ * Quantos passos de INTERVAL_PASSO um ciclista à velocidade de índice v leva para
+ * avançar um metro, e a velocidade em km/h, para a saída.
+ */
+static inline int passos_por_metro(simulacao_t* simulacao, int v) {
+    return simulacao->modelo->passos[v];
+}
+
+static inline int km_por_hora(simulacao_t* simulacao, int v) {
+    return simulacao->modelo->velocidades[v];
+}
+
+/* vetorial.c */
+typedef int (*coletor_t)(int* espera, const int* ativo, int n, int decremento, int* prontos);
+int coletar_prontos(int* espera, const int* ativo, int n, int decremento, int* prontos);
+int coletar_prontos_escalar(int* espera, const int* ativo, int n, int decremento, int* prontos);
+coletor_t coletor_avx2();
+
+/* lote.c */
+void simular_lote_em_paralelo(int d, int n, int faixas, int largada, int motor,
+                              int corridas, unsigned long semente, int n_workers, modelo_t* modelo,
+                              int depurar, FILE* saida);
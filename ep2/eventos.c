@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "ep2.h"
+
+/**
+ * Fila de prioridade (heap mínimo) com o próximo evento de cada ciclista ainda na
+ * pista. Cada evento é uma única chave instante * n + k, em que instante está em
+ * microssegundos de tempo simulado e k é o índice do ciclista em
+ * simulacao->ciclistas: comparar chaves ordena pelo instante e desfaz empates pelo
+ * índice, sem precisar consultar nenhum outro vetor.
+ */
+typedef struct info_eventos {
+    int n;
+    int tamanho;
+    long* heap;
+} eventos_t;
+
+
+eventos_t* init_eventos(simulacao_t* simulacao) {
+    eventos_t* eventos;
+
+    eventos = (eventos_t*) malloc(sizeof(eventos_t));
+    eventos->n = simulacao->n;
+    eventos->tamanho = 0;
+    eventos->heap = (long*) malloc(eventos->n * sizeof(long));
+
+    return eventos;
+}
+
+
+void free_eventos(eventos_t* eventos) {
+    free(eventos->heap);
+    free(eventos);
+}
+
+
+/**
+ * Agenda o próximo evento do k-ésimo ciclista, que não pode estar no heap.
+ */
+void agendar(eventos_t* eventos, int k, long instante) {
+    long chave;
+    int filho, pai;
+
+    chave = instante * eventos->n + k;
+    filho = eventos->tamanho++;
+    while (filho > 0) {
+        pai = (filho - 1) / 2;
+        if (eventos->heap[pai] <= chave) break;
+        eventos->heap[filho] = eventos->heap[pai];
+        filho = pai;
+    }
+    eventos->heap[filho] = chave;
+}
+
+
+/**
+ * Retira do heap o evento mais próximo, devolvendo o ciclista e o instante dele.
+ */
+int proximo_evento(eventos_t* eventos, long* instante) {
+    long primeiro, ultimo;
+    int pai, filho;
+
+    primeiro = eventos->heap[0];
+    ultimo = eventos->heap[--eventos->tamanho];
+
+    pai = 0;
+    while ((filho = 2 * pai + 1) < eventos->tamanho) {
+        if (filho + 1 < eventos->tamanho && eventos->heap[filho + 1] < eventos->heap[filho]) {
+            filho++;
+        }
+        if (ultimo <= eventos->heap[filho]) break;
+        eventos->heap[pai] = eventos->heap[filho];
+        pai = filho;
+    }
+    eventos->heap[pai] = ultimo;
+
+    *instante = primeiro / eventos->n;
+    return primeiro % eventos->n;
+}
+
+
+/**
+ * Move um ciclista uma posição adiante, como mover_ciclista, mas sem operações
+ * atômicas: no motor de eventos só uma thread mexe na pista.
+ */
+void mover_em_eventos(simulacao_t* simulacao, ciclista_t* ciclista) {
+    int i, prox_i, prox_j;
+
+    i = ciclista->i;
+    if (!proxima_posicao(simulacao, i, ciclista->j, &prox_i, &prox_j)) return;
+
+    ocupar_sem_disputa(simulacao, prox_i, prox_j, ciclista->id);
+    desocupar_sem_disputa(simulacao, i, ciclista->j);
+    ciclista->i = prox_i;
+    ciclista->j = prox_j;
+
+    if (prox_i == 0 && i == simulacao->d - 1) {
+        completar_volta(simulacao, ciclista);
+    }
+}
+
+
+/**
+ * Motor de eventos: em vez de avançar o relógio em passos fixos, salta direto para o
+ * instante do próximo movimento. Só o ciclista cujo evento venceu é processado; ele
+ * se move e reagenda o próximo evento para daqui a intervalo(ciclista). O tempo
+ * simulado não tem relação com o tempo real, e a corrida termina assim que o último
+ * ciclista deixa a pista.
+ */
+void simular_em_eventos(simulacao_t* simulacao) {
+    int k;
+    long agora;
+    eventos_t* eventos;
+    ciclista_t* ciclista;
+
+    eventos = init_eventos(simulacao);
+    for (k = 0; k < simulacao->n; k++) {
+        agendar(eventos, k, 0);
+    }
+
+    agora = 0;
+    while (eventos->tamanho > 0) {
+        k = proximo_evento(eventos, &agora);
+        ciclista = simulacao->ciclistas[k];
+
+        /**
+         * Como nos outros motores, um ciclista eliminado ou quebrado só deixa a pista
+         * quando termina o intervalo do seu último movimento.
+         */
+        if (ciclista->quebrado || ciclista->eliminado || restantes_na_corrida(simulacao) == 0) {
+            desocupar_sem_disputa(simulacao, ciclista->i, ciclista->j);
+            ciclista->tempo_gasto = agora / INTERVAL_1MS;
+            if (simulacao->trajetoria) {
+                gravar_trajetoria(simulacao->trajetoria, agora / INTERVAL_PASSO, k,
+                                  ciclista->i, ciclista->j, km_por_hora(simulacao, ciclista->velocidade), FALSE);
+            }
+            continue;
+        }
+
+        agendar(eventos, k, agora + intervalo(ciclista));
+        mover_em_eventos(simulacao, ciclista);
+        if (simulacao->trajetoria) {
+            gravar_trajetoria(simulacao->trajetoria, agora / INTERVAL_PASSO, k,
+                              ciclista->i, ciclista->j, km_por_hora(simulacao, ciclista->velocidade), TRUE);
+        }
+    }
+    debug("Tempo simulado: %ldms\n", agora / INTERVAL_1MS);
+
+    free_eventos(eventos);
+}
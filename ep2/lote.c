@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "ep2.h"
+
+/**
+ * Largura, em milissegundos, de cada faixa do histograma de dispersão dos tempos.
+ */
+#define FAIXA_DISPERSAO 1000
+
+/**
+ * Histogramas acumulados ao longo de várias corridas. Cada worker tem os seus, que só
+ * são somados no final, para que ninguém dispute contadores durante o lote.
+ */
+typedef struct info_estatisticas {
+    long corridas;
+    long* vencedor_por_largada;     // índice: posição na largada, a partir de 0
+    long* quebras_por_volta;        // índice: volta em que o ciclista quebrou
+    int tam_quebras;
+    long* dispersao;                // índice: (último tempo - primeiro tempo) / FAIXA_DISPERSAO
+    int tam_dispersao;
+} estatisticas_t;
+
+typedef struct info_lote {
+    int d;
+    int n;
+    int faixas;
+    int largada;
+    int motor;
+    int corridas;
+    int depurar;
+    modelo_t* modelo;
+    unsigned long semente;
+    int proxima_corrida;            // distribuída atomicamente entre os workers
+} lote_t;
+
+typedef struct info_worker_lote {
+    lote_t* lote;
+    estatisticas_t estatisticas;
+} worker_lote_t;
+
+
+void init_estatisticas(estatisticas_t* estatisticas, int n) {
+    estatisticas->corridas = 0;
+    estatisticas->vencedor_por_largada = (long*) calloc(n, sizeof(long));
+    estatisticas->tam_quebras = 2*n + 1;
+    estatisticas->quebras_por_volta = (long*) calloc(estatisticas->tam_quebras, sizeof(long));
+    estatisticas->dispersao = NULL;
+    estatisticas->tam_dispersao = 0;
+}
+
+
+void free_estatisticas(estatisticas_t* estatisticas) {
+    free(estatisticas->vencedor_por_largada);
+    free(estatisticas->quebras_por_volta);
+    free(estatisticas->dispersao);
+}
+
+
+void contar_dispersao(estatisticas_t* estatisticas, int faixa, long quantidade) {
+    int tamanho;
+
+    if (faixa >= estatisticas->tam_dispersao) {
+        tamanho = estatisticas->tam_dispersao;
+        estatisticas->tam_dispersao = 2 * faixa + 1;
+        estatisticas->dispersao = (long*) realloc(estatisticas->dispersao,
+                                                  estatisticas->tam_dispersao * sizeof(long));
+        while (tamanho < estatisticas->tam_dispersao) {
+            estatisticas->dispersao[tamanho++] = 0;
+        }
+    }
+    estatisticas->dispersao[faixa] += quantidade;
+}
+
+
+/**
+ * A volta em que um ciclista quebra não tem limite: quem não é eliminado pode passar
+ * muito das 2n voltas previstas quando as eliminações atrasam. O histograma cresce
+ * conforme precisa, como o da dispersão.
+ */
+void contar_quebras(estatisticas_t* estatisticas, int volta, long quantidade) {
+    int tamanho;
+
+    if (volta >= estatisticas->tam_quebras) {
+        tamanho = estatisticas->tam_quebras;
+        estatisticas->tam_quebras = 2 * volta + 1;
+        estatisticas->quebras_por_volta = (long*) realloc(estatisticas->quebras_por_volta,
+                                                          estatisticas->tam_quebras * sizeof(long));
+        while (tamanho < estatisticas->tam_quebras) {
+            estatisticas->quebras_por_volta[tamanho++] = 0;
+        }
+    }
+    estatisticas->quebras_por_volta[volta] += quantidade;
+}
+
+
+/**
+ * Soma os resultados de uma corrida que acabou de terminar. A posição na largada de
+ * um ciclista é a ordem em que ele foi posto no grid por dar_largada, da fila da
+ * frente para a de trás.
+ */
+void registrar_corrida(estatisticas_t* estatisticas, simulacao_t* simulacao) {
+    int k, vencedor;
+    double primeiro, ultimo;
+    ciclista_t* ciclista;
+
+    estatisticas->corridas++;
+
+    /**
+     * O vencedor é o último a deixar a corrida. Não é necessariamente o líder: quando
+     * uma saída fecha várias voltas de eliminação de uma vez, quem estava na frente
+     * pode ser eliminado por último ter cruzado uma delas.
+     */
+    vencedor = simulacao->n_fora > 0 ? simulacao->ordem_de_saida[simulacao->n_fora - 1] : -1;
+
+    primeiro = ultimo = simulacao->ciclistas[0]->tempo_gasto;
+    for (k = 0; k < simulacao->n; k++) {
+        ciclista = simulacao->ciclistas[k];
+
+        if (ciclista->id == vencedor) {
+            estatisticas->vencedor_por_largada[k]++;
+        }
+        if (ciclista->quebrado) {
+            contar_quebras(estatisticas, ciclista->volta_atual, 1);
+        }
+        if (ciclista->tempo_gasto < primeiro) primeiro = ciclista->tempo_gasto;
+        if (ciclista->tempo_gasto > ultimo) ultimo = ciclista->tempo_gasto;
+    }
+
+    contar_dispersao(estatisticas, (int) (ultimo - primeiro) / FAIXA_DISPERSAO, 1);
+}
+
+
+/**
+ * Laço de cada worker: pega a próxima corrida ainda não simulada, roda com a semente
+ * do lote deslocada pelo número da corrida e acumula o resultado nos seus
+ * histogramas. Cada corrida tem sua própria simulacao_t, então nada é compartilhado
+ * além do contador de corridas.
+ */
+void* simular_lote(void* args) {
+    worker_lote_t* worker = (worker_lote_t*) args;
+    lote_t* lote = worker->lote;
+    simulacao_t* simulacao;
+    int corrida;
+
+    while ((corrida = __atomic_fetch_add(&lote->proxima_corrida, 1, __ATOMIC_RELAXED)) < lote->corridas) {
+        simulacao = init_simulacao(lote->d, lote->n, lote->faixas, lote->largada,
+                                   lote->semente + corrida);
+        simulacao->saida = NULL;
+        simulacao->modelo = lote->modelo;
+        simulacao->depurar = lote->depurar;
+        dar_largada(simulacao, lote->d, lote->n);
+
+        if (lote->motor == MOTOR_EVENTOS) {
+            simular_em_eventos(simulacao);
+        } else if (lote->motor == MOTOR_TICKS) {
+            simular_em_ticks(simulacao, 1);
+        } else if (lote->motor == MOTOR_SEGMENTOS) {
+            simular_em_segmentos(simulacao, 1);
+        } else {
+            simular_em_passos(simulacao);
+        }
+        imprimir_rankings(simulacao, TRUE);
+
+        registrar_corrida(&worker->estatisticas, simulacao);
+        free_simulacao(simulacao);
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Escreve os histogramas num CSV com uma linha por barra: o nome do histograma, o
+ * valor no eixo x e quantas vezes ele apareceu.
+ */
+void escrever_csv(FILE* saida, estatisticas_t* estatisticas, int n) {
+    int k;
+
+    fprintf(saida, "histograma,valor,contagem\n");
+    fprintf(saida, "corridas,,%ld\n", estatisticas->corridas);
+    for (k = 0; k < n; k++) {
+        fprintf(saida, "vencedor_por_largada,%d,%ld\n", k + 1, estatisticas->vencedor_por_largada[k]);
+    }
+    for (k = 1; k < estatisticas->tam_quebras; k++) {
+        if (k <= 2*n || estatisticas->quebras_por_volta[k]) {
+            fprintf(saida, "quebras_por_volta,%d,%ld\n", k, estatisticas->quebras_por_volta[k]);
+        }
+    }
+    for (k = 0; k < estatisticas->tam_dispersao; k++) {
+        if (estatisticas->dispersao[k]) {
+            fprintf(saida, "dispersao_tempo_s,%d,%ld\n", k * FAIXA_DISPERSAO / 1000, estatisticas->dispersao[k]);
+        }
+    }
+}
+
+
+/**
+ * Modo em lote: roda `corridas` corridas independentes, com sementes semente,
+ * semente + 1, ..., espalhadas por n_workers threads, e escreve em `saida` os
+ * histogramas de vencedor por posição de largada, quebras por volta e dispersão dos
+ * tempos de prova (do primeiro ao último ciclista a deixar a pista).
+ */
+void simular_lote_em_paralelo(int d, int n, int faixas, int largada, int motor,
+                              int corridas, unsigned long semente, int n_workers, modelo_t* modelo,
+                              int depurar, FILE* saida) {
+    int t, k;
+    lote_t lote;
+    pthread_t* threads;
+    worker_lote_t* workers;
+    estatisticas_t* total;
+
+    if (n_workers < 1) n_workers = 1;
+
+    lote.d = d;
+    lote.n = n;
+    lote.faixas = faixas;
+    lote.largada = largada;
+    lote.motor = motor;
+    lote.corridas = corridas;
+    lote.semente = semente;
+    lote.modelo = modelo;
+    lote.depurar = depurar;
+    lote.proxima_corrida = 0;
+
+    threads = (pthread_t*) malloc(n_workers * sizeof(pthread_t));
+    workers = (worker_lote_t*) malloc(n_workers * sizeof(worker_lote_t));
+
+    for (t = 0; t < n_workers; t++) {
+        workers[t].lote = &lote;
+        init_estatisticas(&workers[t].estatisticas, n);
+        pthread_create(&threads[t], NULL, simular_lote, &workers[t]);
+    }
+
+    total = &workers[0].estatisticas;
+    pthread_join(threads[0], NULL);
+    for (t = 1; t < n_workers; t++) {
+        pthread_join(threads[t], NULL);
+
+        total->corridas += workers[t].estatisticas.corridas;
+        for (k = 0; k < n; k++) {
+            total->vencedor_por_largada[k] += workers[t].estatisticas.vencedor_por_largada[k];
+        }
+        for (k = 0; k < workers[t].estatisticas.tam_quebras; k++) {
+            if (workers[t].estatisticas.quebras_por_volta[k]) {
+                contar_quebras(total, k, workers[t].estatisticas.quebras_por_volta[k]);
+            }
+        }
+        for (k = 0; k < workers[t].estatisticas.tam_dispersao; k++) {
+            if (workers[t].estatisticas.dispersao[k]) {
+                contar_dispersao(total, k, workers[t].estatisticas.dispersao[k]);
+            }
+        }
+    }
+
+    escrever_csv(saida, total, n);
+
+    for (t = 0; t < n_workers; t++) {
+        free_estatisticas(&workers[t].estatisticas);
+    }
+    free(workers);
+    free(threads);
+}
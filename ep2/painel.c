@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include "ep2.h"
+
+/**
+ * Linha do terminal em que começa a pista; a primeira é o título.
+ */
+#define PRIMEIRA_LINHA 2
+
+/**
+ * Coluna do terminal em que começa a primeira faixa, depois do número do metro.
+ */
+#define PRIMEIRA_COLUNA 9
+
+/**
+ * Painel da pista no modo de depuração. Ele guarda o que está na tela e, a cada
+ * quadro, só reescreve as células que mudaram, posicionando o cursor com sequências
+ * ANSI. O quadro inteiro é montado num buffer e vai para o terminal numa única
+ * escrita. A janela ocupa o topo da tela; o que mais for escrito em stderr – rankings,
+ * mensagens de depuração – rola na região abaixo dela.
+ */
+struct info_painel {
+    int altura;             // metros exibidos
+    int largura_celula;
+    int inicio;             // primeiro metro exibido no quadro anterior, ou -1
+    int* metros;            // metro exibido em cada linha, ou -1
+    int* celulas;           // ocupante exibido em cada célula, ou um valor impossível
+    int linha_cursor;       // onde o cursor ficou depois da última escrita
+    int coluna_cursor;
+    char* buffer;
+    size_t tamanho;
+    size_t capacidade;
+};
+
+
+void escrever_no_painel(painel_t* painel, const char* formato, ...) {
+    va_list args;
+    int escritos;
+
+    for (;;) {
+        va_start(args, formato);
+        escritos = vsnprintf(painel->buffer + painel->tamanho, painel->capacidade - painel->tamanho,
+                             formato, args);
+        va_end(args);
+
+        if (painel->tamanho + escritos < painel->capacidade) break;
+        painel->capacidade = 2 * (painel->tamanho + escritos + 1);
+        painel->buffer = (char*) realloc(painel->buffer, painel->capacidade);
+    }
+    painel->tamanho += escritos;
+}
+
+
+/**
+ * Põe o cursor na linha e coluna dadas, a não ser que ele já esteja lá.
+ */
+void posicionar(painel_t* painel, int linha, int coluna) {
+    if (linha != painel->linha_cursor || coluna != painel->coluna_cursor) {
+        escrever_no_painel(painel, "\033[%d;%dH", linha, coluna);
+    }
+}
+
+
+painel_t* init_painel(simulacao_t* simulacao, int janela) {
+    int k, n_celulas, maior_id;
+    painel_t* painel;
+
+    painel = (painel_t*) malloc(sizeof(painel_t));
+    painel->altura = (janela < 1 || janela > simulacao->d) ? simulacao->d : janela;
+    painel->inicio = -1;
+
+    maior_id = simulacao->n - 1;
+    for (painel->largura_celula = 2; maior_id >= 10; maior_id /= 10) painel->largura_celula++;
+    painel->largura_celula++;
+
+    n_celulas = painel->altura * simulacao->faixas;
+    painel->metros = (int*) malloc(painel->altura * sizeof(int));
+    painel->celulas = (int*) malloc(n_celulas * sizeof(int));
+    for (k = 0; k < painel->altura; k++) painel->metros[k] = -1;
+    for (k = 0; k < n_celulas; k++) painel->celulas[k] = VAZIA - 1;
+
+    painel->capacidade = 4096;
+    painel->buffer = (char*) malloc(painel->capacidade);
+    painel->tamanho = 0;
+
+    /**
+     * Limpa a tela e restringe a rolagem às linhas abaixo da janela.
+     */
+    escrever_no_painel(painel, "\033[2J\033[%d;r\033[%d;1H", PRIMEIRA_LINHA + painel->altura + 1,
+                       PRIMEIRA_LINHA + painel->altura + 1);
+    fwrite(painel->buffer, 1, painel->tamanho, stderr);
+
+    return painel;
+}
+
+
+/**
+ * Devolve a rolagem ao terminal inteiro e libera o painel.
+ */
+void free_painel(painel_t* painel) {
+    fputs("\0337\033[r\0338", stderr);
+    free(painel->metros);
+    free(painel->celulas);
+    free(painel->buffer);
+    free(painel);
+}
+
+
+/**
+ * Metro em que está o líder da corrida. Antes que alguém complete a primeira volta,
+ * é o metro mais adiantado com algum ciclista.
+ */
+int metro_do_lider(simulacao_t* simulacao) {
+    int i, j;
+    lideranca_t lideranca;
+
+    __atomic_load(&simulacao->lideranca, &lideranca, __ATOMIC_ACQUIRE);
+    if (lideranca.lider != -1) {
+        for (i = 0; i < simulacao->d; i++) {
+            for (j = 0; j < simulacao->faixas; j++) {
+                if (ocupante(simulacao, i, j) == lideranca.lider) return i;
+            }
+        }
+    }
+    for (i = simulacao->d - 1; i > 0; i--) {
+        for (j = 0; j < simulacao->faixas; j++) {
+            if (ocupante(simulacao, i, j) != VAZIA) return i;
+        }
+    }
+    return 0;
+}
+
+
+/**
+ * Desenha um quadro da pista. Se a janela for menor que a pista, ela acompanha o
+ * líder, deixando-o no meio da tela. Corridas sem painel – as do modo em lote, por
+ * exemplo – não desenham nada.
+ */
+void desenhar_painel(simulacao_t* simulacao) {
+    painel_t* painel = simulacao->painel;
+    int inicio, linha, i, j, id, *celula;
+
+    if (painel == NULL) return;
+
+    inicio = 0;
+    if (painel->altura < simulacao->d) {
+        inicio = (metro_do_lider(simulacao) - painel->altura / 2 + simulacao->d) % simulacao->d;
+    }
+
+    painel->tamanho = 0;
+    painel->linha_cursor = painel->coluna_cursor = -1;
+    escrever_no_painel(painel, "\0337");
+
+    if (inicio != painel->inicio) {
+        posicionar(painel, 1, 1);
+        escrever_no_painel(painel, "\033[2KPista: metros %d a %d de %d", inicio + 1,
+                           (inicio + painel->altura - 1) % simulacao->d + 1, simulacao->d);
+        painel->inicio = inicio;
+    }
+
+    for (linha = 0; linha < painel->altura; linha++) {
+        i = (inicio + linha) % simulacao->d;
+        if (painel->metros[linha] != i) {
+            posicionar(painel, PRIMEIRA_LINHA + linha, 1);
+            escrever_no_painel(painel, "%6d: ", i + 1);
+            painel->linha_cursor = PRIMEIRA_LINHA + linha;
+            painel->coluna_cursor = PRIMEIRA_COLUNA;
+            painel->metros[linha] = i;
+        }
+
+        for (j = 0; j < simulacao->faixas; j++) {
+            id = ocupante(simulacao, i, j);
+            celula = &painel->celulas[linha * simulacao->faixas + j];
+            if (*celula == id) continue;
+
+            posicionar(painel, PRIMEIRA_LINHA + linha, PRIMEIRA_COLUNA + j * painel->largura_celula);
+            if (id != VAZIA) {
+                escrever_no_painel(painel, "%*d", painel->largura_celula, id);
+            } else {
+                escrever_no_painel(painel, "%*s", painel->largura_celula, "-");
+            }
+            painel->linha_cursor = PRIMEIRA_LINHA + linha;
+            painel->coluna_cursor = PRIMEIRA_COLUNA + (j + 1) * painel->largura_celula;
+            *celula = id;
+        }
+    }
+
+    /**
+     * Um quadro sem mudanças não precisa ir para o terminal.
+     */
+    if (painel->tamanho > 2) {
+        escrever_no_painel(painel, "\0338");
+        fwrite(painel->buffer, 1, painel->tamanho, stderr);
+    }
+}
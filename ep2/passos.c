@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "ep2.h"
+
+/**
+ * Estado "quente" dos ciclistas no motor de passos, organizado como uma estrutura
+ * de vetores: o k-ésimo elemento de cada vetor se refere a simulacao->ciclistas[k].
+ * Volta, ranking e quebra continuam nos ciclista_t, que só são tocados quando
+ * alguém cruza a linha de chegada.
+ */
+struct info_passos {
+    int n;
+    long passo;         // passos já simulados
+    int* i;             // metro em que o ciclista está
+    int* j;             // faixa em que o ciclista está
+    int* velocidade;
+    int* espera;        // passos que faltam até o próximo movimento
+    int* tempo_gasto;   // em passos
+    int* ativo;         // se o ciclista ainda ocupa uma posição na pista
+    int* prontos;       // ciclistas que se movem no passo atual, em ordem crescente
+};
+
+
+passos_t* init_passos(simulacao_t* simulacao) {
+    int k, n;
+    passos_t* passos;
+    ciclista_t* ciclista;
+
+    n = simulacao->n;
+    passos = (passos_t*) malloc(sizeof(passos_t));
+    passos->n = n;
+    passos->passo = 0;
+    passos->i = (int*) malloc(n * sizeof(int));
+    passos->j = (int*) malloc(n * sizeof(int));
+    passos->velocidade = (int*) malloc(n * sizeof(int));
+    passos->espera = (int*) malloc(n * sizeof(int));
+    passos->tempo_gasto = (int*) malloc(n * sizeof(int));
+    passos->ativo = (int*) malloc(n * sizeof(int));
+    passos->prontos = (int*) malloc(n * sizeof(int));
+
+    for (k = 0; k < n; k++) {
+        ciclista = simulacao->ciclistas[k];
+        passos->i[k] = ciclista->i;
+        passos->j[k] = ciclista->j;
+        passos->velocidade[k] = ciclista->velocidade;
+        passos->espera[k] = 0;
+        passos->tempo_gasto[k] = 0;
+        passos->ativo[k] = TRUE;
+    }
+
+    return passos;
+}
+
+
+void free_passos(passos_t* passos) {
+    free(passos->i);
+    free(passos->j);
+    free(passos->velocidade);
+    free(passos->espera);
+    free(passos->tempo_gasto);
+    free(passos->ativo);
+    free(passos->prontos);
+    free(passos);
+}
+
+
+/**
+ * Move o k-ésimo ciclista uma posição adiante seguindo as mesmas regras de
+ * ultrapassagem do motor com threads. Como só há uma linha de execução, não é
+ * preciso disputar nenhuma posição da pista.
+ */
+void mover_em_passos(simulacao_t* simulacao, passos_t* passos, int k) {
+    ciclista_t* ciclista;
+    int i, prox_i, prox_j;
+
+    i = passos->i[k];
+    if (!proxima_posicao(simulacao, i, passos->j[k], &prox_i, &prox_j)) return;
+
+    ciclista = simulacao->ciclistas[k];
+    ocupar_sem_disputa(simulacao, prox_i, prox_j, ciclista->id);
+    desocupar_sem_disputa(simulacao, i, passos->j[k]);
+    passos->i[k] = prox_i;
+    passos->j[k] = prox_j;
+
+    if (prox_i == 0 && i == simulacao->d - 1) {
+        completar_volta(simulacao, ciclista);
+        passos->velocidade[k] = ciclista->velocidade;
+    }
+}
+
+
+/**
+ * Tira o k-ésimo ciclista da pista, registrando por quanto tempo ele correu.
+ */
+void retirar_em_passos(simulacao_t* simulacao, passos_t* passos, int k) {
+    ciclista_t* ciclista;
+
+    ciclista = simulacao->ciclistas[k];
+    desocupar_sem_disputa(simulacao, passos->i[k], passos->j[k]);
+
+    ciclista->i = passos->i[k];
+    ciclista->j = passos->j[k];
+    ciclista->tempo_gasto = passos->tempo_gasto[k] * (INTERVAL_PASSO / INTERVAL_1MS);
+    passos->ativo[k] = FALSE;
+}
+
+
+/**
+ * Repassa o estado do k-ésimo ciclista ao gravador de trajetória, se houver um.
+ */
+static inline void gravar_em_passos(simulacao_t* simulacao, passos_t* passos, long passo, int k) {
+    if (simulacao->trajetoria) {
+        gravar_trajetoria(simulacao->trajetoria, passo, k, passos->i[k], passos->j[k],
+                          km_por_hora(simulacao, passos->velocidade[k]), passos->ativo[k]);
+    }
+}
+
+
+/**
+ * Simula até `max_passos` passos da corrida, ou até que ela termine. Devolve TRUE se
+ * ainda há ciclistas na pista. Chamadas seguidas continuam de onde a anterior parou,
+ * então uma corrida pode ser simulada aos poucos, intercalada com outras.
+ */
+int avancar_passos(simulacao_t* simulacao, passos_t* passos, long max_passos) {
+    int k, n, p, n_prontos, espera;
+    long passo, ultimo;
+    ciclista_t* ciclista;
+
+    n = passos->n;
+    passo = passos->passo;
+    ultimo = max_passos > LONG_MAX - passo ? LONG_MAX : passo + max_passos;
+
+    /**
+     * Os prontos de cada passo são coletados junto com o decremento das esperas no
+     * fim do passo anterior (ver vetorial.c); os do primeiro vêm do estado atual.
+     * Mover um ciclista não muda a espera nem o estado de nenhum outro, então a lista
+     * continua valendo enquanto ela é percorrida.
+     */
+    n_prontos = coletar_prontos(passos->espera, passos->ativo, n, 0, passos->prontos);
+
+    while (restantes_na_corrida(simulacao) > 0 && passo < ultimo) {
+        for (p = 0; p < n_prontos; p++) {
+            k = passos->prontos[p];
+
+            /**
+             * Assim como no motor com threads, um ciclista eliminado ou quebrado só
+             * deixa a pista quando termina o intervalo do seu último movimento.
+             */
+            ciclista = simulacao->ciclistas[k];
+            if (ciclista->quebrado || ciclista->eliminado) {
+                retirar_em_passos(simulacao, passos, k);
+                gravar_em_passos(simulacao, passos, passo, k);
+                continue;
+            }
+
+            espera = passos_por_metro(simulacao, passos->velocidade[k]);
+            mover_em_passos(simulacao, passos, k);
+            gravar_em_passos(simulacao, passos, passo, k);
+
+            passos->espera[k] = espera;
+            passos->tempo_gasto[k] += espera;
+        }
+
+        n_prontos = coletar_prontos(passos->espera, passos->ativo, n, 1, passos->prontos);
+        passo++;
+
+        if (simulacao->depurar) {
+            desenhar_painel(simulacao);
+        }
+    }
+
+    passos->passo = passo;
+    return restantes_na_corrida(simulacao) > 0;
+}
+
+
+/**
+ * Tira da pista quem ainda estiver nela e libera o estado do motor.
+ */
+void encerrar_passos(simulacao_t* simulacao, passos_t* passos) {
+    int k;
+
+    for (k = 0; k < passos->n; k++) {
+        if (passos->ativo[k]) {
+            retirar_em_passos(simulacao, passos, k);
+            gravar_em_passos(simulacao, passos, passos->passo, k);
+        }
+    }
+    debug("Tempo simulado: %ldms\n", passos->passo * (INTERVAL_PASSO / INTERVAL_1MS));
+
+    free_passos(passos);
+}
+
+
+/**
+ * Grava o estado do motor no ponto de restauração, depois do da simulação.
+ */
+void salvar_passos(passos_t* passos, FILE* arquivo) {
+    int k;
+
+    gravar_numero(arquivo, passos->passo);
+    for (k = 0; k < passos->n; k++) {
+        gravar_numero(arquivo, passos->i[k]);
+        gravar_numero(arquivo, passos->j[k]);
+        gravar_numero(arquivo, passos->velocidade[k]);
+        gravar_numero(arquivo, passos->espera[k]);
+        gravar_numero(arquivo, passos->tempo_gasto[k]);
+        gravar_numero(arquivo, passos->ativo[k]);
+    }
+}
+
+
+/**
+ * Lê o estado gravado por salvar_passos e põe de volta na pista os ciclistas que
+ * ainda estavam nela. Devolve NULL se o arquivo acabar antes da hora.
+ */
+passos_t* restaurar_passos(simulacao_t* simulacao, FILE* arquivo) {
+    passos_t* passos;
+    ciclista_t* ciclista;
+    int k, ok;
+
+    ok = TRUE;
+    passos = init_passos(simulacao);
+    passos->passo = ler_numero(arquivo, &ok);
+    for (k = 0; k < passos->n; k++) {
+        passos->i[k] = ler_numero(arquivo, &ok);
+        passos->j[k] = ler_numero(arquivo, &ok);
+        passos->velocidade[k] = ler_numero(arquivo, &ok);
+        if (passos->velocidade[k] < 0 || passos->velocidade[k] >= simulacao->modelo->n_velocidades) ok = FALSE;
+        passos->espera[k] = ler_numero(arquivo, &ok);
+        passos->tempo_gasto[k] = ler_numero(arquivo, &ok);
+        passos->ativo[k] = ler_numero(arquivo, &ok);
+    }
+    if (!ok) {
+        free_passos(passos);
+        return NULL;
+    }
+
+    /**
+     * Fora do motor, a posição de um ciclista ainda na pista só é atualizada quando
+     * ele completa uma volta; a do motor é a que vale.
+     */
+    for (k = 0; k < passos->n; k++) {
+        if (!passos->ativo[k]) continue;
+        ciclista = simulacao->ciclistas[k];
+        if (passos->i[k] < 0 || passos->i[k] >= simulacao->d || passos->j[k] < 0 ||
+            passos->j[k] >= simulacao->faixas || ocupante(simulacao, passos->i[k], passos->j[k]) != VAZIA) {
+            free_passos(passos);
+            return NULL;
+        }
+        ciclista->i = passos->i[k];
+        ciclista->j = passos->j[k];
+        ocupar_sem_disputa(simulacao, ciclista->i, ciclista->j, ciclista->id);
+    }
+
+    return passos;
+}
+
+
+/**
+ * Continua uma corrida do ponto em que `passos` parou – o começo, para um estado
+ * recém-criado, ou um ponto de restauração – até o fim, e libera o estado do motor.
+ */
+void continuar_em_passos(simulacao_t* simulacao, passos_t* passos) {
+    while (avancar_passos(simulacao, passos, LONG_MAX));
+    encerrar_passos(simulacao, passos);
+}
+
+
+/**
+ * Motor de passos: em vez de uma thread por ciclista, um único laço avança o
+ * relógio simulado de INTERVAL_PASSO em INTERVAL_PASSO e move, em ordem fixa,
+ * todos os ciclistas cujo intervalo terminou naquele passo. Não há espera real,
+ * então a corrida termina muito mais rápido do que em tempo real, e o resultado
+ * depende apenas da sequência de números aleatórios.
+ */
+void simular_em_passos(simulacao_t* simulacao) {
+    continuar_em_passos(simulacao, init_passos(simulacao));
+}
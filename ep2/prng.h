@@ -0,0 +1,47 @@
+#include <stdint.h>
+
+/**
+ * Gerador de números pseudoaleatórios PCG32 (O'Neill, 2014). Cada ciclista tem o seu,
+ * de modo que sorteios em threads diferentes não disputam o estado global de rand()
+ * e uma mesma semente sempre reproduz a mesma sequência para cada ciclista.
+ */
+typedef struct info_prng {
+    uint64_t estado;
+    uint64_t incremento;    // define o fluxo; precisa ser ímpar
+} prng_t;
+
+
+static inline uint32_t prng_proximo(prng_t* prng) {
+    uint64_t anterior;
+    uint32_t embaralhado, rotacao;
+
+    anterior = prng->estado;
+    prng->estado = anterior * 6364136223846793005ULL + prng->incremento;
+
+    embaralhado = (uint32_t) (((anterior >> 18u) ^ anterior) >> 27u);
+    rotacao = (uint32_t) (anterior >> 59u);
+
+    return (embaralhado >> rotacao) | (embaralhado << ((-rotacao) & 31));
+}
+
+
+/**
+ * Inicializa o gerador. Geradores com a mesma semente e fluxos diferentes produzem
+ * sequências independentes.
+ */
+static inline void prng_semear(prng_t* prng, uint64_t semente, uint64_t fluxo) {
+    prng->estado = 0;
+    prng->incremento = (fluxo << 1u) | 1u;
+    prng_proximo(prng);
+    prng->estado += semente;
+    prng_proximo(prng);
+}
+
+
+/**
+ * Sorteia um inteiro em [0, limite), mapeando os 32 bits sorteados para o intervalo
+ * com uma multiplicação em vez de uma divisão.
+ */
+static inline int prng_sortear(prng_t* prng, int limite) {
+    return (int) (((uint64_t) prng_proximo(prng) * (uint32_t) limite) >> 32);
+}
@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "ep2.h"
+#include "trajetoria.h"
+
+/**
+ * Decodificador dos arquivos gravados com --trajetoria. Escreve em stdout uma linha
+ * por mudança, com o instante em milissegundos de tempo simulado, o ciclista, a
+ * posição e a velocidade dele depois da mudança e o que aconteceu:
+ *
+ *   tempo_ms ciclista metro faixa velocidade evento
+ */
+
+typedef struct info_leitura {
+    int d;
+    int n;
+    int faixas;
+    int* id;
+    int* i;
+    int* j;
+    int* velocidade;
+    long tick;
+    int cabecalho_lido;
+} leitura_t;
+
+
+/**
+ * Lê o próximo varint do bloco, falhando se ele acabar no meio.
+ */
+int proximo(const unsigned char** cursor, const unsigned char* fim, uint64_t* valor) {
+    size_t lidos = ler_varint(*cursor, fim, valor);
+
+    *cursor += lidos;
+    return lidos > 0;
+}
+
+
+int ler_cabecalho(leitura_t* leitura, const unsigned char** cursor, const unsigned char* fim) {
+    uint64_t d, n, faixas, id, i, j, velocidade;
+    int k;
+
+    if (!proximo(cursor, fim, &d) || !proximo(cursor, fim, &n) || !proximo(cursor, fim, &faixas)) {
+        return FALSE;
+    }
+    leitura->d = d;
+    leitura->n = n;
+    leitura->faixas = faixas;
+    leitura->id = (int*) malloc(n * sizeof(int));
+    leitura->i = (int*) malloc(n * sizeof(int));
+    leitura->j = (int*) malloc(n * sizeof(int));
+    leitura->velocidade = (int*) malloc(n * sizeof(int));
+
+    printf("# d=%d n=%d faixas=%d\n", leitura->d, leitura->n, leitura->faixas);
+    printf("tempo_ms ciclista metro faixa velocidade evento\n");
+    for (k = 0; k < leitura->n; k++) {
+        if (!proximo(cursor, fim, &id) || !proximo(cursor, fim, &i) ||
+            !proximo(cursor, fim, &j) || !proximo(cursor, fim, &velocidade)) {
+            return FALSE;
+        }
+        leitura->id[k] = id;
+        leitura->i[k] = i;
+        leitura->j[k] = j;
+        leitura->velocidade[k] = velocidade;
+        printf("0 %d %d %d %d largada\n", leitura->id[k], leitura->i[k], leitura->j[k], leitura->velocidade[k]);
+    }
+
+    leitura->cabecalho_lido = TRUE;
+    return TRUE;
+}
+
+
+/**
+ * Decodifica todos os registros de um bloco já descomprimido.
+ */
+int ler_bloco(leitura_t* leitura, const unsigned char* cursor, const unsigned char* fim) {
+    uint64_t ticks, n_mudancas, dk, marcas, di, dj, dv;
+    long tempo;
+    int k;
+
+    if (!leitura->cabecalho_lido && !ler_cabecalho(leitura, &cursor, fim)) {
+        return FALSE;
+    }
+
+    while (cursor < fim) {
+        if (!proximo(&cursor, fim, &ticks) || !proximo(&cursor, fim, &n_mudancas)) {
+            return FALSE;
+        }
+        leitura->tick += ticks;
+        tempo = leitura->tick * (INTERVAL_PASSO / INTERVAL_1MS);
+
+        k = -1;
+        while (n_mudancas-- > 0) {
+            if (!proximo(&cursor, fim, &dk) || !proximo(&cursor, fim, &marcas)) return FALSE;
+            k += dk + 1;
+            if (k >= leitura->n) return FALSE;
+
+            if (marcas & MUDOU_POSICAO) {
+                if (!proximo(&cursor, fim, &di) || !proximo(&cursor, fim, &dj)) return FALSE;
+                leitura->i[k] = (leitura->i[k] + di) % leitura->d;
+                leitura->j[k] += desfazer_zigzag(dj);
+            }
+            if (marcas & MUDOU_VELOCIDADE) {
+                if (!proximo(&cursor, fim, &dv)) return FALSE;
+                leitura->velocidade[k] += desfazer_zigzag(dv);
+            }
+
+            printf("%ld %d %d %d %d %s\n", tempo, leitura->id[k], leitura->i[k], leitura->j[k],
+                   leitura->velocidade[k],
+                   (marcas & SAIU_DA_PISTA) ? "saiu" : (marcas & MUDOU_POSICAO) ? "moveu" : "velocidade");
+        }
+    }
+
+    return TRUE;
+}
+
+
+/**
+ * Lê um varint direto do arquivo, para os tamanhos que precedem cada bloco. Devolve
+ * FALSE no fim do arquivo.
+ */
+int ler_varint_arquivo(FILE* arquivo, uint64_t* valor) {
+    int byte, deslocamento;
+
+    *valor = 0;
+    for (deslocamento = 0; deslocamento < 64; deslocamento += 7) {
+        if ((byte = fgetc(arquivo)) == EOF) return FALSE;
+        *valor |= (uint64_t) (byte & 0x7f) << deslocamento;
+        if (!(byte & 0x80)) return TRUE;
+    }
+    return FALSE;
+}
+
+
+int main(int argc, char* argv[]) {
+    FILE* arquivo;
+    char magica[sizeof(MAGICA_TRAJETORIA)];
+    unsigned char* comprimido = NULL;
+    unsigned char* bloco = NULL;
+    uint64_t tam_original, tam_comprimido;
+    uLongf tamanho;
+    leitura_t leitura;
+    int ok;
+
+    if (argc < 2) {
+        fprintf(stderr, "Uso: ./reproduzir <trajetoria>\n");
+        return 1;
+    }
+    arquivo = fopen(argv[1], "rb");
+    if (arquivo == NULL) {
+        fprintf(stderr, "Não foi possível abrir o arquivo de trajetória %s\n", argv[1]);
+        return 1;
+    }
+
+    magica[sizeof(magica) - 1] = '\0';
+    if (fread(magica, 1, sizeof(magica) - 1, arquivo) != sizeof(magica) - 1 ||
+        strcmp(magica, MAGICA_TRAJETORIA) || fgetc(arquivo) != VERSAO_TRAJETORIA) {
+        fprintf(stderr, "%s não é um arquivo de trajetória\n", argv[1]);
+        return 1;
+    }
+
+    memset(&leitura, 0, sizeof(leitura));
+    ok = TRUE;
+    while (ok && ler_varint_arquivo(arquivo, &tam_original)) {
+        ok = ler_varint_arquivo(arquivo, &tam_comprimido);
+        if (!ok) break;
+
+        comprimido = (unsigned char*) realloc(comprimido, tam_comprimido);
+        bloco = (unsigned char*) realloc(bloco, tam_original);
+        tamanho = tam_original;
+        ok = fread(comprimido, 1, tam_comprimido, arquivo) == tam_comprimido &&
+             uncompress(bloco, &tamanho, comprimido, tam_comprimido) == Z_OK &&
+             tamanho == tam_original &&
+             ler_bloco(&leitura, bloco, bloco + tamanho);
+    }
+    if (!ok) {
+        fprintf(stderr, "Arquivo de trajetória corrompido\n");
+    }
+
+    free(comprimido);
+    free(bloco);
+    free(leitura.id);
+    free(leitura.i);
+    free(leitura.j);
+    free(leitura.velocidade);
+    fclose(arquivo);
+
+    return !ok;
+}
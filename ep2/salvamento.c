@@ -0,0 +1,342 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ep2.h"
+#include "trajetoria.h"
+
+/**
+ * Pontos de restauração do motor de passos. O arquivo começa com MAGICA_SALVAMENTO e
+ * VERSAO_SALVAMENTO e segue com um fluxo de varints, todos em zigzag:
+ *
+ *   d, n, faixas, largada, semente
+ *   modelo de velocidades: velocidades e marcas, largada, restantes do regime final e
+ *     as tabelas de transição das velocidades existentes
+ *   estado da simulação: restantes, ha_ciclista_a_90, líder e sua volta, próximo
+ *     ranking a imprimir, ordem de saída, último ranking publicado, gerador da largada
+ *   para cada ciclista, na ordem de simulacao->ciclistas: id, velocidade, eliminado,
+ *     quebrado, i, j, volta, tempo gasto (os bits do double) e gerador
+ *   para cada uma das 2n + 1 voltas: registrados, se já eliminou alguém, se foi
+ *     concluída e, se a lista ainda não foi liberada, os ids dela
+ *   estado do motor de passos (salvar_passos)
+ *
+ * As velocidades dos ciclistas são índices no modelo, então uma corrida só pode ser
+ * restaurada com o mesmo modelo com que foi gravada. A pista não é gravada: ela é
+ * refeita a partir das posições de quem ainda está nela. As pendentes de cada volta
+ * também não: entre dois passos, quem está na corrida está pendente na volta seguinte
+ * à última que registrou.
+ * Como todo sorteio vem dos geradores gravados e o motor de passos é determinístico,
+ * a corrida restaurada segue exatamente como a original seguiria.
+ */
+#define MAGICA_SALVAMENTO "EP2S"
+#define VERSAO_SALVAMENTO 3
+
+
+void gravar_numero(FILE* arquivo, int64_t valor) {
+    unsigned char buffer[MAX_VARINT];
+
+    fwrite(buffer, 1, escrever_varint(buffer, zigzag(valor)), arquivo);
+}
+
+
+/**
+ * Lê um número gravado por gravar_numero. Se o arquivo acabar no meio dele, zera *ok
+ * e devolve 0; depois disso, as leituras seguintes também devolvem 0.
+ */
+int64_t ler_numero(FILE* arquivo, int* ok) {
+    uint64_t valor;
+    int c, deslocamento;
+
+    if (!*ok) return 0;
+
+    valor = 0;
+    for (deslocamento = 0; deslocamento < 64; deslocamento += 7) {
+        if ((c = fgetc(arquivo)) == EOF) break;
+        valor |= (uint64_t) (c & 0x7f) << deslocamento;
+        if (!(c & 0x80)) return desfazer_zigzag(valor);
+    }
+    *ok = FALSE;
+    return 0;
+}
+
+
+/**
+ * Lê um número que precisa estar em [0, limite).
+ */
+int ler_indice(FILE* arquivo, int limite, int* ok) {
+    int64_t valor;
+
+    valor = ler_numero(arquivo, ok);
+    if (valor < 0 || valor >= limite) {
+        *ok = FALSE;
+        return 0;
+    }
+    return (int) valor;
+}
+
+
+void gravar_prng(FILE* arquivo, prng_t* prng) {
+    gravar_numero(arquivo, (int64_t) prng->estado);
+    gravar_numero(arquivo, (int64_t) prng->incremento);
+}
+
+
+void ler_prng(FILE* arquivo, prng_t* prng, int* ok) {
+    prng->estado = (uint64_t) ler_numero(arquivo, ok);
+    prng->incremento = (uint64_t) ler_numero(arquivo, ok);
+}
+
+
+void gravar_modelo(FILE* arquivo, modelo_t* modelo) {
+    int r, v, s;
+
+    gravar_numero(arquivo, modelo->n_velocidades);
+    for (v = 0; v < modelo->n_velocidades; v++) {
+        gravar_numero(arquivo, modelo->velocidades[v]);
+        gravar_numero(arquivo, modelo->encerra_final[v]);
+    }
+    gravar_numero(arquivo, modelo->inicial);
+    gravar_numero(arquivo, modelo->restantes_final);
+    for (r = 0; r < N_REGIMES; r++) {
+        for (v = 0; v < modelo->n_velocidades; v++) {
+            for (s = 0; s < N_SORTEIOS; s++) gravar_numero(arquivo, modelo->proxima[r][v][s]);
+        }
+    }
+}
+
+
+/**
+ * Lê o modelo gravado por gravar_modelo e confere se ele é igual a `modelo`.
+ */
+int conferir_modelo(FILE* arquivo, modelo_t* modelo, int* ok) {
+    int r, v, s, igual;
+
+    igual = ler_numero(arquivo, ok) == modelo->n_velocidades;
+    for (v = 0; igual && v < modelo->n_velocidades; v++) {
+        igual = ler_numero(arquivo, ok) == modelo->velocidades[v] &&
+                ler_numero(arquivo, ok) == modelo->encerra_final[v];
+    }
+    igual = igual && ler_numero(arquivo, ok) == modelo->inicial &&
+            ler_numero(arquivo, ok) == modelo->restantes_final;
+    for (r = 0; igual && r < N_REGIMES; r++) {
+        for (v = 0; igual && v < modelo->n_velocidades; v++) {
+            for (s = 0; igual && s < N_SORTEIOS; s++) {
+                igual = ler_numero(arquivo, ok) == modelo->proxima[r][v][s];
+            }
+        }
+    }
+    return igual && *ok;
+}
+
+
+/**
+ * Grava a corrida num ponto de restauração. Só faz sentido entre dois passos do
+ * motor de passos, quando nenhum ciclista está no meio de um movimento.
+ */
+int salvar_simulacao(simulacao_t* simulacao, passos_t* passos, const char* caminho) {
+    FILE* arquivo;
+    ciclista_t* ciclista;
+    ranking_t* ranking;
+    uint64_t bits;
+    int k, v, ok;
+
+    if ((arquivo = fopen(caminho, "wb")) == NULL) {
+        fprintf(stderr, "Não foi possível criar o ponto de restauração %s\n", caminho);
+        return FALSE;
+    }
+
+    fwrite(MAGICA_SALVAMENTO, 1, 4, arquivo);
+    gravar_numero(arquivo, VERSAO_SALVAMENTO);
+    gravar_numero(arquivo, simulacao->d);
+    gravar_numero(arquivo, simulacao->n);
+    gravar_numero(arquivo, simulacao->faixas);
+    gravar_numero(arquivo, simulacao->largada);
+    gravar_numero(arquivo, (int64_t) simulacao->semente);
+    gravar_modelo(arquivo, simulacao->modelo);
+
+    gravar_numero(arquivo, restantes_na_corrida(simulacao));
+    gravar_numero(arquivo, simulacao->ha_ciclista_a_90);
+    gravar_numero(arquivo, simulacao->lideranca.lider);
+    gravar_numero(arquivo, simulacao->lideranca.volta);
+    gravar_numero(arquivo, simulacao->proximo_ranking);
+    gravar_numero(arquivo, simulacao->n_fora);
+    for (k = 0; k < simulacao->n_fora; k++) {
+        gravar_numero(arquivo, simulacao->ordem_de_saida[k]);
+    }
+    gravar_numero(arquivo, simulacao->volta_ultimo_ranking);
+    gravar_numero(arquivo, simulacao->tam_ultimo_ranking);
+    for (k = 0; k < simulacao->tam_ultimo_ranking; k++) {
+        gravar_numero(arquivo, simulacao->ultimo_ranking[k]);
+    }
+    gravar_prng(arquivo, &simulacao->prng);
+
+    for (k = 0; k < simulacao->n; k++) {
+        ciclista = simulacao->ciclistas[k];
+        gravar_numero(arquivo, ciclista->id);
+        gravar_numero(arquivo, ciclista->velocidade);
+        gravar_numero(arquivo, ciclista->eliminado);
+        gravar_numero(arquivo, ciclista->quebrado);
+        gravar_numero(arquivo, ciclista->i);
+        gravar_numero(arquivo, ciclista->j);
+        gravar_numero(arquivo, ciclista->volta_atual);
+        memcpy(&bits, &ciclista->tempo_gasto, sizeof(bits));
+        gravar_numero(arquivo, (int64_t) bits);
+        gravar_prng(arquivo, &ciclista->prng);
+    }
+
+    for (v = 0; v <= 2*simulacao->n; v++) {
+        ranking = simulacao->ranking_voltas[v];
+        gravar_numero(arquivo, ranking->ciclistas_registrados);
+        gravar_numero(arquivo, ranking->ciclista_eliminado);
+        gravar_numero(arquivo, ranking->concluida);
+        gravar_numero(arquivo, ranking->ciclistas != NULL);
+        if (ranking->ciclistas != NULL) {
+            for (k = 0; k < ranking->ciclistas_registrados; k++) {
+                gravar_numero(arquivo, ranking->ciclistas[k]->id);
+            }
+        }
+    }
+
+    salvar_passos(passos, arquivo);
+
+    ok = !ferror(arquivo);
+    ok = !fclose(arquivo) && ok;
+    if (!ok) {
+        fprintf(stderr, "Não foi possível gravar o ponto de restauração %s\n", caminho);
+    }
+    return ok;
+}
+
+
+/**
+ * Refaz a corrida de um ponto de restauração. A simulação volta pronta para ser
+ * continuada pelo motor de passos, com o estado dele em *passos. Devolve NULL se o
+ * arquivo não puder ser lido ou não for um ponto de restauração válido.
+ */
+simulacao_t* restaurar_simulacao(const char* caminho, modelo_t* modelo, passos_t** passos) {
+    FILE* arquivo;
+    simulacao_t* simulacao;
+    ciclista_t* ciclista;
+    ciclista_t** por_id;
+    ranking_t* ranking;
+    char magica[4];
+    uint64_t bits;
+    int d, n, faixas, largada, k, v, id, ok;
+    unsigned long semente;
+
+    if ((arquivo = fopen(caminho, "rb")) == NULL) {
+        fprintf(stderr, "Não foi possível abrir o ponto de restauração %s\n", caminho);
+        return NULL;
+    }
+
+    ok = fread(magica, 1, 4, arquivo) == 4 && !memcmp(magica, MAGICA_SALVAMENTO, 4);
+    if (ler_numero(arquivo, &ok) != VERSAO_SALVAMENTO) ok = FALSE;
+    d = ler_numero(arquivo, &ok);
+    n = ler_numero(arquivo, &ok);
+    faixas = ler_numero(arquivo, &ok);
+    largada = ler_numero(arquivo, &ok);
+    semente = (unsigned long) ler_numero(arquivo, &ok);
+    if (!ok || n < 1 || faixas < 1 || largada < 1 || largada > faixas || d < (n + largada - 1) / largada) {
+        fprintf(stderr, "%s não é um ponto de restauração válido\n", caminho);
+        fclose(arquivo);
+        return NULL;
+    }
+    if (!conferir_modelo(arquivo, modelo, &ok)) {
+        fprintf(stderr, "%s foi gravado com outro modelo de velocidades\n", caminho);
+        fclose(arquivo);
+        return NULL;
+    }
+
+    simulacao = init_simulacao(d, n, faixas, largada, semente);
+    simulacao->modelo = modelo;
+    simulacao->ciclistas_restantes = ler_indice(arquivo, n + 1, &ok);
+    simulacao->ha_ciclista_a_90 = ler_numero(arquivo, &ok);
+    simulacao->lideranca.lider = ler_numero(arquivo, &ok);
+    simulacao->lideranca.volta = ler_numero(arquivo, &ok);
+    simulacao->proximo_ranking = ler_indice(arquivo, 2*n + 1, &ok);
+    simulacao->n_fora = ler_indice(arquivo, n + 1, &ok);
+    for (k = 0; k < simulacao->n_fora; k++) {
+        simulacao->ordem_de_saida[k] = ler_indice(arquivo, n, &ok);
+    }
+    simulacao->volta_ultimo_ranking = ler_numero(arquivo, &ok);
+    simulacao->tam_ultimo_ranking = ler_indice(arquivo, n + 1, &ok);
+    for (k = 0; k < simulacao->tam_ultimo_ranking; k++) {
+        simulacao->ultimo_ranking[k] = ler_indice(arquivo, n, &ok);
+    }
+    ler_prng(arquivo, &simulacao->prng, &ok);
+
+    por_id = (ciclista_t**) calloc(n, sizeof(ciclista_t*));
+    for (k = 0; k < n && ok; k++) {
+        id = ler_indice(arquivo, n, &ok);
+        if (!ok || por_id[id] != NULL) {
+            ok = FALSE;
+            break;
+        }
+        ciclista = init_ciclista(simulacao, id, 0, 0);
+        simulacao->ciclistas[k] = por_id[id] = ciclista;
+
+        ciclista->velocidade = ler_indice(arquivo, modelo->n_velocidades, &ok);
+        ciclista->eliminado = ler_numero(arquivo, &ok);
+        ciclista->quebrado = ler_numero(arquivo, &ok);
+        ciclista->i = ler_indice(arquivo, d, &ok);
+        ciclista->j = ler_indice(arquivo, faixas, &ok);
+        ciclista->volta_atual = ler_numero(arquivo, &ok);
+        bits = (uint64_t) ler_numero(arquivo, &ok);
+        memcpy(&ciclista->tempo_gasto, &bits, sizeof(bits));
+        ler_prng(arquivo, &ciclista->prng, &ok);
+    }
+
+    for (v = 0; v <= 2*n && ok; v++) {
+        ranking = simulacao->ranking_voltas[v];
+        ranking->ciclistas_registrados = ler_indice(arquivo, n + 1, &ok);
+        ranking->ciclista_eliminado = ler_numero(arquivo, &ok);
+        ranking->concluida = ler_numero(arquivo, &ok);
+        if (ler_numero(arquivo, &ok) && ok) {
+            ranking->ciclistas = (ciclista_t**) malloc(capacidade_da_volta(simulacao, ranking) * sizeof(ciclista_t*));
+            for (k = 0; k < ranking->ciclistas_registrados; k++) {
+                ranking->ciclistas[k] = por_id[ler_indice(arquivo, n, &ok)];
+            }
+        }
+    }
+    free(por_id);
+
+    simulacao->ranking_voltas[0]->pendentes = 0;
+    for (k = 0; k < n && ok; k++) {
+        ciclista = simulacao->ciclistas[k];
+        if (ciclista->volta_atual < 1) ok = FALSE;
+        if (ciclista->eliminado || ciclista->quebrado || !ok) {
+            ciclista->volta_pendente = SAIU;
+        } else {
+            ciclista->volta_pendente = ciclista->volta_atual - 1 < 2*n ? ciclista->volta_atual - 1 : 2*n;
+            simulacao->ranking_voltas[ciclista->volta_pendente]->pendentes++;
+        }
+    }
+    while (simulacao->volta_aberta < 2*n && simulacao->ranking_voltas[simulacao->volta_aberta]->concluida) {
+        simulacao->volta_aberta++;
+    }
+
+    *passos = ok ? restaurar_passos(simulacao, arquivo) : NULL;
+    fclose(arquivo);
+
+    if (*passos == NULL) {
+        fprintf(stderr, "%s não é um ponto de restauração válido\n", caminho);
+        free_simulacao(simulacao);
+        return NULL;
+    }
+    return simulacao;
+}
+
+
+/**
+ * Simula a corrida no motor de passos até o fim do passo em que o líder completa a
+ * volta `volta` e grava ali um ponto de restauração. Quem chama continua a corrida
+ * normalmente depois, como se nada tivesse sido gravado.
+ */
+int salvar_na_volta(simulacao_t* simulacao, passos_t* passos, const char* caminho, int volta) {
+    while (simulacao->lideranca.volta + 1 < volta) {
+        if (!avancar_passos(simulacao, passos, 1)) {
+            fprintf(stderr, "A corrida terminou antes de alguém completar a volta %d\n", volta);
+            return FALSE;
+        }
+    }
+    return salvar_simulacao(simulacao, passos, caminho);
+}
@@ -0,0 +1,318 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "ep2.h"
+
+/**
+ * Menor comprimento de um segmento. Com pelo menos dois metros, o último metro de um
+ * segmento – de onde saem as travessias – nunca é o primeiro, onde elas chegam.
+ */
+#define MIN_METROS_SEGMENTO 2
+
+/**
+ * Fronteira entre o segmento s e o seguinte. Quem está no último metro de s e quer
+ * avançar entra em `travessias`; o dono do segmento seguinte decide quem consegue
+ * entrar e devolve os demais em `devolvidos`.
+ */
+typedef struct info_fronteira {
+    int* travessias;
+    int n_travessias;
+    int* devolvidos;
+    int n_devolvidos;
+} fronteira_t;
+
+typedef struct info_segmento {
+    int id;
+    int inicio;                 // metros [inicio, fim) da pista
+    int fim;
+    int* ciclistas;             // índices dos ciclistas dentro do segmento
+    int n_ciclistas;
+    long movimentos;
+    struct info_segmentos* segmentos;
+    pthread_t thread;
+} segmento_t;
+
+/**
+ * Estado do motor de segmentos. Os dados dos ciclistas ficam em vetores indexados
+ * como simulacao->ciclistas, como no motor de passos; cada ciclista só é lido e
+ * escrito pelo dono do segmento em que está.
+ */
+typedef struct info_segmentos {
+    simulacao_t* simulacao;
+    int n;
+    int n_segmentos;
+    int* i;
+    int* j;
+    int* velocidade;
+    int* espera;                // ticks que faltam até o próximo movimento
+    int* tempo_gasto;           // em ticks
+    int* ativo;
+    segmento_t* segmento;
+    fronteira_t* fronteira;
+    int fim;
+    long tick;
+    pthread_barrier_t barreira;
+} segmentos_t;
+
+
+segmentos_t* init_segmentos(simulacao_t* simulacao, int n_segmentos) {
+    int k, s, n;
+    segmentos_t* segmentos;
+    segmento_t* segmento;
+    ciclista_t* ciclista;
+
+    n = simulacao->n;
+    segmentos = (segmentos_t*) malloc(sizeof(segmentos_t));
+    segmentos->simulacao = simulacao;
+    segmentos->n = n;
+    segmentos->n_segmentos = n_segmentos;
+    segmentos->i = (int*) malloc(n * sizeof(int));
+    segmentos->j = (int*) malloc(n * sizeof(int));
+    segmentos->velocidade = (int*) malloc(n * sizeof(int));
+    segmentos->espera = (int*) malloc(n * sizeof(int));
+    segmentos->tempo_gasto = (int*) malloc(n * sizeof(int));
+    segmentos->ativo = (int*) malloc(n * sizeof(int));
+    segmentos->segmento = (segmento_t*) malloc(n_segmentos * sizeof(segmento_t));
+    segmentos->fronteira = (fronteira_t*) malloc(n_segmentos * sizeof(fronteira_t));
+    segmentos->fim = FALSE;
+    segmentos->tick = 0;
+    pthread_barrier_init(&segmentos->barreira, NULL, n_segmentos);
+
+    for (s = 0; s < n_segmentos; s++) {
+        segmento = &segmentos->segmento[s];
+        segmento->id = s;
+        segmento->inicio = (long) simulacao->d * s / n_segmentos;
+        segmento->fim = (long) simulacao->d * (s + 1) / n_segmentos;
+        segmento->ciclistas = (int*) malloc(n * sizeof(int));
+        segmento->n_ciclistas = 0;
+        segmento->movimentos = 0;
+        segmento->segmentos = segmentos;
+
+        segmentos->fronteira[s].travessias = (int*) malloc(n * sizeof(int));
+        segmentos->fronteira[s].n_travessias = 0;
+        segmentos->fronteira[s].devolvidos = (int*) malloc(n * sizeof(int));
+        segmentos->fronteira[s].n_devolvidos = 0;
+    }
+
+    for (k = 0; k < n; k++) {
+        ciclista = simulacao->ciclistas[k];
+        segmentos->i[k] = ciclista->i;
+        segmentos->j[k] = ciclista->j;
+        segmentos->velocidade[k] = ciclista->velocidade;
+        segmentos->espera[k] = 0;
+        segmentos->tempo_gasto[k] = 0;
+        segmentos->ativo[k] = TRUE;
+
+        s = (long) ciclista->i * n_segmentos / simulacao->d;
+        while (segmentos->segmento[s].inicio > ciclista->i) s--;
+        while (segmentos->segmento[s].fim <= ciclista->i) s++;
+        segmento = &segmentos->segmento[s];
+        segmento->ciclistas[segmento->n_ciclistas++] = k;
+    }
+
+    return segmentos;
+}
+
+
+void free_segmentos(segmentos_t* segmentos) {
+    int s;
+
+    for (s = 0; s < segmentos->n_segmentos; s++) {
+        free(segmentos->segmento[s].ciclistas);
+        free(segmentos->fronteira[s].travessias);
+        free(segmentos->fronteira[s].devolvidos);
+    }
+    pthread_barrier_destroy(&segmentos->barreira);
+    free(segmentos->i);
+    free(segmentos->j);
+    free(segmentos->velocidade);
+    free(segmentos->espera);
+    free(segmentos->tempo_gasto);
+    free(segmentos->ativo);
+    free(segmentos->segmento);
+    free(segmentos->fronteira);
+    free(segmentos);
+}
+
+
+/**
+ * Tira o k-ésimo ciclista da pista, registrando por quanto tempo ele correu.
+ */
+void retirar_em_segmentos(segmentos_t* segmentos, int k) {
+    simulacao_t* simulacao = segmentos->simulacao;
+    ciclista_t* ciclista;
+
+    ciclista = simulacao->ciclistas[k];
+    desocupar_sem_disputa(simulacao, segmentos->i[k], segmentos->j[k]);
+
+    ciclista->i = segmentos->i[k];
+    ciclista->j = segmentos->j[k];
+    ciclista->tempo_gasto = segmentos->tempo_gasto[k] * (INTERVAL_PASSO / INTERVAL_1MS);
+    segmentos->ativo[k] = FALSE;
+}
+
+
+/**
+ * Primeira fase do tick: o dono do segmento move, um a um e sem nenhuma trava, os
+ * ciclistas cujo intervalo terminou. Todas as posições que ele lê e escreve são
+ * suas, exceto pelas travessias, que ficam para a segunda fase.
+ */
+void mover_no_segmento(segmento_t* segmento) {
+    segmentos_t* segmentos = segmento->segmentos;
+    simulacao_t* simulacao = segmentos->simulacao;
+    fronteira_t* saida = &segmentos->fronteira[segmento->id];
+    ciclista_t* ciclista;
+    int a, b, k, prox_i, prox_j, espera;
+
+    /**
+     * Quem não conseguiu atravessar no tick anterior continua aqui.
+     */
+    for (a = 0; a < saida->n_devolvidos; a++) {
+        segmento->ciclistas[segmento->n_ciclistas++] = saida->devolvidos[a];
+    }
+    saida->n_devolvidos = 0;
+
+    for (a = b = 0; a < segmento->n_ciclistas; a++) {
+        k = segmento->ciclistas[a];
+        if (segmentos->espera[k] > 0) {
+            segmento->ciclistas[b++] = k;
+            continue;
+        }
+
+        ciclista = simulacao->ciclistas[k];
+        if (ciclista->quebrado || ciclista->eliminado) {
+            retirar_em_segmentos(segmentos, k);
+            continue;
+        }
+
+        espera = passos_por_metro(simulacao, segmentos->velocidade[k]);
+        segmentos->espera[k] = espera;
+        segmentos->tempo_gasto[k] += espera;
+        segmento->movimentos++;
+
+        if (segmentos->i[k] == segmento->fim - 1) {
+            saida->travessias[saida->n_travessias++] = k;
+            continue;
+        }
+
+        if (proxima_posicao(simulacao, segmentos->i[k], segmentos->j[k], &prox_i, &prox_j)) {
+            ocupar_sem_disputa(simulacao, prox_i, prox_j, ciclista->id);
+            desocupar_sem_disputa(simulacao, segmentos->i[k], segmentos->j[k]);
+            segmentos->i[k] = prox_i;
+            segmentos->j[k] = prox_j;
+        }
+        segmento->ciclistas[b++] = k;
+    }
+    segmento->n_ciclistas = b;
+}
+
+
+/**
+ * Segunda fase do tick: o dono do segmento recebe, na ordem em que chegaram, os
+ * ciclistas que querem entrar pelo seu primeiro metro. Ele também libera a posição
+ * que cada um deixou no último metro do segmento anterior, que ninguém mais toca
+ * nesta fase. Só o segmento que começa no metro 0 vê ciclistas completando voltas.
+ */
+void receber_travessias(segmento_t* segmento) {
+    segmentos_t* segmentos = segmento->segmentos;
+    simulacao_t* simulacao = segmentos->simulacao;
+    fronteira_t* entrada;
+    ciclista_t* ciclista;
+    int a, k, prox_j;
+
+    entrada = &segmentos->fronteira[(segmento->id + segmentos->n_segmentos - 1) % segmentos->n_segmentos];
+
+    for (a = 0; a < entrada->n_travessias; a++) {
+        k = entrada->travessias[a];
+        prox_j = primeira_faixa_livre(simulacao, segmento->inicio, segmentos->j[k]);
+        if (prox_j < 0) {
+            entrada->devolvidos[entrada->n_devolvidos++] = k;
+            continue;
+        }
+
+        ciclista = simulacao->ciclistas[k];
+        ocupar_sem_disputa(simulacao, segmento->inicio, prox_j, ciclista->id);
+        desocupar_sem_disputa(simulacao, segmentos->i[k], segmentos->j[k]);
+        segmentos->i[k] = segmento->inicio;
+        segmentos->j[k] = prox_j;
+        segmento->ciclistas[segmento->n_ciclistas++] = k;
+
+        if (segmento->inicio == 0) {
+            ciclista->i = segmentos->i[k];
+            ciclista->j = segmentos->j[k];
+            completar_volta(simulacao, ciclista);
+            segmentos->velocidade[k] = ciclista->velocidade;
+        }
+    }
+    entrada->n_travessias = 0;
+
+    for (a = 0; a < segmento->n_ciclistas; a++) {
+        segmentos->espera[segmento->ciclistas[a]]--;
+    }
+    for (a = 0; a < entrada->n_devolvidos; a++) {
+        segmentos->espera[entrada->devolvidos[a]]--;
+    }
+}
+
+
+void* simular_segmento(void* args) {
+    segmento_t* segmento = (segmento_t*) args;
+    segmentos_t* segmentos = segmento->segmentos;
+
+    while (!segmentos->fim) {
+        mover_no_segmento(segmento);
+        pthread_barrier_wait(&segmentos->barreira);
+
+        receber_travessias(segmento);
+        pthread_barrier_wait(&segmentos->barreira);
+
+        if (segmento->id == 0) {
+            segmentos->tick++;
+            if (segmentos->simulacao->depurar) {
+                desenhar_painel(segmentos->simulacao);
+            }
+            segmentos->fim = restantes_na_corrida(segmentos->simulacao) == 0;
+        }
+        pthread_barrier_wait(&segmentos->barreira);
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Motor de segmentos: a pista é dividida em trechos contíguos de metros, um por
+ * worker, e cada worker é dono dos ciclistas que estão no seu trecho. Dentro de um
+ * trecho os movimentos são resolvidos em sequência, sem sincronização; só quem passa
+ * de um trecho para o seguinte é entregue ao vizinho, por uma fila por fronteira,
+ * numa segunda fase do tick. Como no motor de ticks, o tempo avança em ticks de
+ * INTERVAL_PASSO e o resultado depende só da semente e do número de workers.
+ */
+void simular_em_segmentos(simulacao_t* simulacao, int n_workers) {
+    int k, s;
+    segmentos_t* segmentos;
+
+    if (n_workers > simulacao->d / MIN_METROS_SEGMENTO) n_workers = simulacao->d / MIN_METROS_SEGMENTO;
+    if (n_workers < 1) n_workers = 1;
+
+    segmentos = init_segmentos(simulacao, n_workers);
+    for (s = 0; s < n_workers; s++) {
+        pthread_create(&segmentos->segmento[s].thread, NULL, simular_segmento, &segmentos->segmento[s]);
+    }
+    for (s = 0; s < n_workers; s++) {
+        pthread_join(segmentos->segmento[s].thread, NULL);
+    }
+
+    for (k = 0; k < segmentos->n; k++) {
+        if (segmentos->ativo[k]) {
+            retirar_em_segmentos(segmentos, k);
+        }
+    }
+    debug("Tempo simulado: %ldms\n", segmentos->tick * (INTERVAL_PASSO / INTERVAL_1MS));
+    for (s = 0; s < n_workers; s++) {
+        debug("Segmento %d (metros %d a %d): %ld movimentos\n", s, segmentos->segmento[s].inicio + 1,
+              segmentos->segmento[s].fim, segmentos->segmento[s].movimentos);
+    }
+
+    free_segmentos(segmentos);
+}
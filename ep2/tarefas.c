@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "ep2.h"
+
+/**
+ * Fim de uma lista da roda de tempo.
+ */
+#define NENHUMA -1
+
+/**
+ * Fila de tarefas prontas de um trabalhador. O dono tira tarefas do fim; quem está
+ * sem trabalho rouba do começo.
+ */
+typedef struct info_fila {
+    int* tarefas;           // anel com espaço para todas as tarefas
+    int capacidade;
+    int inicio;
+    int tamanho;
+    pthread_mutex_t mutex;
+} fila_t;
+
+typedef struct info_trabalhador {
+    int id;
+    struct info_pool* pool;
+    fila_t fila;
+    int* roda;                  // tarefas que acordam em cada um dos próximos ticks
+    long tick;                  // último tick cuja posição da roda já foi esvaziada
+    pthread_t thread;
+} trabalhador_t;
+
+/**
+ * Pool de trabalhadores do motor de tarefas. Cada ciclista é uma tarefa – a k-ésima
+ * é simulacao->ciclistas[k] – que faz um movimento por vez e volta para a roda de
+ * tempo até o próximo.
+ */
+typedef struct info_pool {
+    simulacao_t* simulacao;
+    int n_trabalhadores;
+    trabalhador_t* trabalhadores;
+    int n_posicoes;         // da roda: um INTERVAL_PASSO cada, cobrindo o maior intervalo
+    long* devida;           // tick em que cada tarefa deve rodar
+    int* proxima;           // encadeia as tarefas de uma mesma posição da roda
+    int ativas;             // tarefas que ainda não terminaram
+    struct timespec inicio;
+} pool_t;
+
+
+void init_fila(fila_t* fila, int capacidade) {
+    fila->tarefas = (int*) malloc(capacidade * sizeof(int));
+    fila->capacidade = capacidade;
+    fila->inicio = 0;
+    fila->tamanho = 0;
+    pthread_mutex_init(&fila->mutex, NULL);
+}
+
+
+void free_fila(fila_t* fila) {
+    pthread_mutex_destroy(&fila->mutex);
+    free(fila->tarefas);
+}
+
+
+void empilhar(fila_t* fila, int k) {
+    fila->tarefas[(fila->inicio + fila->tamanho++) % fila->capacidade] = k;
+}
+
+
+int desempilhar(fila_t* fila, int* k) {
+    int ok;
+
+    pthread_mutex_lock(&fila->mutex);
+    ok = fila->tamanho > 0;
+    if (ok) {
+        *k = fila->tarefas[(fila->inicio + --fila->tamanho) % fila->capacidade];
+    }
+    pthread_mutex_unlock(&fila->mutex);
+
+    return ok;
+}
+
+
+int roubar_de(fila_t* fila, int* k) {
+    int ok;
+
+    pthread_mutex_lock(&fila->mutex);
+    ok = fila->tamanho > 0;
+    if (ok) {
+        *k = fila->tarefas[fila->inicio];
+        fila->inicio = (fila->inicio + 1) % fila->capacidade;
+        fila->tamanho--;
+    }
+    pthread_mutex_unlock(&fila->mutex);
+
+    return ok;
+}
+
+
+/**
+ * Tenta roubar uma tarefa dos outros trabalhadores, começando pelo vizinho.
+ */
+int roubar(trabalhador_t* trabalhador, int* k) {
+    pool_t* pool = trabalhador->pool;
+    int t, vitima;
+
+    for (t = 1; t < pool->n_trabalhadores; t++) {
+        vitima = (trabalhador->id + t) % pool->n_trabalhadores;
+        if (roubar_de(&pool->trabalhadores[vitima].fila, k)) return TRUE;
+    }
+    return FALSE;
+}
+
+
+/**
+ * Instante de relógio em que começa um tick.
+ */
+struct timespec instante_do_tick(pool_t* pool, long tick) {
+    struct timespec instante;
+    long ns;
+
+    ns = pool->inicio.tv_nsec + tick * (INTERVAL_PASSO * 1000L);
+    instante.tv_sec = pool->inicio.tv_sec + ns / 1000000000L;
+    instante.tv_nsec = ns % 1000000000L;
+
+    return instante;
+}
+
+
+int tick_ja_comecou(pool_t* pool, long tick) {
+    struct timespec agora, instante;
+
+    clock_gettime(CLOCK_MONOTONIC, &agora);
+    instante = instante_do_tick(pool, tick);
+
+    return agora.tv_sec > instante.tv_sec ||
+           (agora.tv_sec == instante.tv_sec && agora.tv_nsec >= instante.tv_nsec);
+}
+
+
+/**
+ * Põe uma tarefa para acordar no tick em que ela é devida: na roda, se ele ainda não
+ * chegou, ou direto na fila de prontas, se já passou.
+ */
+void agendar_tarefa(trabalhador_t* trabalhador, int k) {
+    pool_t* pool = trabalhador->pool;
+    int posicao;
+
+    if (pool->devida[k] <= trabalhador->tick) {
+        pthread_mutex_lock(&trabalhador->fila.mutex);
+        empilhar(&trabalhador->fila, k);
+        pthread_mutex_unlock(&trabalhador->fila.mutex);
+        return;
+    }
+
+    posicao = pool->devida[k] % pool->n_posicoes;
+    pool->proxima[k] = trabalhador->roda[posicao];
+    trabalhador->roda[posicao] = k;
+}
+
+
+/**
+ * Passa para a fila de prontas todas as tarefas que acordam no tick atual.
+ */
+void girar_roda(trabalhador_t* trabalhador) {
+    pool_t* pool = trabalhador->pool;
+    int k, posicao;
+
+    posicao = trabalhador->tick % pool->n_posicoes;
+    pthread_mutex_lock(&trabalhador->fila.mutex);
+    for (k = trabalhador->roda[posicao]; k != NENHUMA; k = pool->proxima[k]) {
+        empilhar(&trabalhador->fila, k);
+    }
+    pthread_mutex_unlock(&trabalhador->fila.mutex);
+    trabalhador->roda[posicao] = NENHUMA;
+}
+
+
+/**
+ * Um passo do ciclista: o corpo do laço de simular_ciclista, sem o usleep. Em vez de
+ * dormir, a tarefa volta para a roda de tempo, marcada para o tick em que o intervalo
+ * do movimento termina.
+ */
+void executar_tarefa(trabalhador_t* trabalhador, int k) {
+    pool_t* pool = trabalhador->pool;
+    simulacao_t* simulacao = pool->simulacao;
+    ciclista_t* ciclista;
+    int tempo_espera;
+
+    ciclista = simulacao->ciclistas[k];
+    if (ciclista->quebrado || ciclista->eliminado) {
+        remover_ciclista(simulacao, ciclista);
+        __atomic_sub_fetch(&pool->ativas, 1, __ATOMIC_RELEASE);
+        return;
+    }
+
+    tempo_espera = intervalo(ciclista);
+    mover_ciclista(simulacao, ciclista);
+    ciclista->tempo_gasto += tempo_espera / INTERVAL_1MS;
+
+    pool->devida[k] += tempo_espera / INTERVAL_PASSO;
+    agendar_tarefa(trabalhador, k);
+}
+
+
+/**
+ * Laço de cada trabalhador: roda as próprias tarefas prontas; quando elas acabam,
+ * avança a roda se o próximo tick já começou, rouba de outro trabalhador se não, e só
+ * dorme quando não há nada a fazer até o próximo tick.
+ */
+void* trabalhar(void* args) {
+    trabalhador_t* trabalhador = (trabalhador_t*) args;
+    pool_t* pool = trabalhador->pool;
+    struct timespec proximo;
+    int k;
+
+    while (__atomic_load_n(&pool->ativas, __ATOMIC_ACQUIRE) > 0) {
+        if (desempilhar(&trabalhador->fila, &k)) {
+            executar_tarefa(trabalhador, k);
+        } else if (tick_ja_comecou(pool, trabalhador->tick + 1)) {
+            trabalhador->tick++;
+            girar_roda(trabalhador);
+        } else if (roubar(trabalhador, &k)) {
+            executar_tarefa(trabalhador, k);
+        } else {
+            proximo = instante_do_tick(pool, trabalhador->tick + 1);
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &proximo, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Motor de tarefas: a mesma corrida em tempo real do motor com threads, mas cada
+ * ciclista é uma tarefa retomável em vez de uma thread que passa quase todo o tempo
+ * em usleep. Um trabalhador por núcleo executa as tarefas; cada um tem sua roda de
+ * tempo, com uma posição por tick de INTERVAL_PASSO, e rouba tarefas prontas dos
+ * outros quando fica sem nenhuma. Assim o tamanho da corrida não é limitado pelo
+ * número de threads do sistema nem pela memória das pilhas.
+ */
+void simular_em_tarefas(simulacao_t* simulacao, int n_trabalhadores) {
+    int k, t, p;
+    pool_t pool;
+    trabalhador_t* trabalhador;
+
+    if (n_trabalhadores < 1) n_trabalhadores = 1;
+
+    pool.simulacao = simulacao;
+    pool.n_trabalhadores = n_trabalhadores;
+    pool.n_posicoes = simulacao->modelo->max_passos + 1;
+    pool.trabalhadores = (trabalhador_t*) malloc(n_trabalhadores * sizeof(trabalhador_t));
+    pool.devida = (long*) calloc(simulacao->n, sizeof(long));
+    pool.proxima = (int*) malloc(simulacao->n * sizeof(int));
+    pool.ativas = simulacao->n;
+
+    for (t = 0; t < n_trabalhadores; t++) {
+        trabalhador = &pool.trabalhadores[t];
+        trabalhador->id = t;
+        trabalhador->pool = &pool;
+        trabalhador->tick = 0;
+        init_fila(&trabalhador->fila, simulacao->n);
+        trabalhador->roda = (int*) malloc(pool.n_posicoes * sizeof(int));
+        for (p = 0; p < pool.n_posicoes; p++) {
+            trabalhador->roda[p] = NENHUMA;
+        }
+    }
+
+    /**
+     * Todos os ciclistas fazem o primeiro movimento no tick 0, divididos igualmente
+     * entre os trabalhadores.
+     */
+    for (k = 0; k < simulacao->n; k++) {
+        empilhar(&pool.trabalhadores[k % n_trabalhadores].fila, k);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &pool.inicio);
+    for (t = 0; t < n_trabalhadores; t++) {
+        pthread_create(&pool.trabalhadores[t].thread, NULL, trabalhar, &pool.trabalhadores[t]);
+    }
+
+    acompanhar_corrida(simulacao);
+
+    for (t = 0; t < n_trabalhadores; t++) {
+        pthread_join(pool.trabalhadores[t].thread, NULL);
+        free_fila(&pool.trabalhadores[t].fila);
+        free(pool.trabalhadores[t].roda);
+    }
+
+    free(pool.trabalhadores);
+    free(pool.devida);
+    free(pool.proxima);
+}
@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "ep2.h"
+
+/**
+ * Marca de uma posição que ninguém reivindicou no tick atual.
+ */
+#define SEM_REIVINDICACAO -1
+
+/**
+ * Estado do motor de ticks. Assim como no motor de passos, os dados "quentes" dos
+ * ciclistas ficam numa estrutura de vetores indexada como simulacao->ciclistas.
+ */
+typedef struct info_ticks {
+    simulacao_t* simulacao;
+    int n;
+    int n_workers;
+    int* i;
+    int* j;
+    int* velocidade;
+    int* espera;            // ticks que faltam até o próximo movimento
+    int* tempo_gasto;       // em ticks
+    int* ativo;
+    int* proposta;          // posição pretendida no tick atual, ou VAZIA
+    int* retirar;           // o ciclista deixa a pista ao fim do tick
+    int* mudou_volta;       // o ciclista cruzou a linha de chegada no tick atual
+    int* reivindicacao;     // por posição da pista: menor k que a quer neste tick
+    int fim;
+    long tick;
+    pthread_barrier_t barreira;
+} ticks_t;
+
+typedef struct info_worker {
+    int id;
+    ticks_t* ticks;
+} worker_t;
+
+
+ticks_t* init_ticks(simulacao_t* simulacao, int n_workers) {
+    int k, n, n_posicoes;
+    ticks_t* ticks;
+    ciclista_t* ciclista;
+
+    n = simulacao->n;
+    n_posicoes = simulacao->d * simulacao->faixas;
+
+    ticks = (ticks_t*) malloc(sizeof(ticks_t));
+    ticks->simulacao = simulacao;
+    ticks->n = n;
+    ticks->n_workers = n_workers;
+    ticks->i = (int*) malloc(n * sizeof(int));
+    ticks->j = (int*) malloc(n * sizeof(int));
+    ticks->velocidade = (int*) malloc(n * sizeof(int));
+    ticks->espera = (int*) malloc(n * sizeof(int));
+    ticks->tempo_gasto = (int*) malloc(n * sizeof(int));
+    ticks->ativo = (int*) malloc(n * sizeof(int));
+    ticks->proposta = (int*) malloc(n * sizeof(int));
+    ticks->retirar = (int*) malloc(n * sizeof(int));
+    ticks->mudou_volta = (int*) malloc(n * sizeof(int));
+    ticks->reivindicacao = (int*) malloc(n_posicoes * sizeof(int));
+    ticks->fim = FALSE;
+    ticks->tick = 0;
+    pthread_barrier_init(&ticks->barreira, NULL, n_workers);
+
+    for (k = 0; k < n; k++) {
+        ciclista = simulacao->ciclistas[k];
+        ticks->i[k] = ciclista->i;
+        ticks->j[k] = ciclista->j;
+        ticks->velocidade[k] = ciclista->velocidade;
+        ticks->espera[k] = 0;
+        ticks->tempo_gasto[k] = 0;
+        ticks->ativo[k] = TRUE;
+        ticks->proposta[k] = VAZIA;
+        ticks->retirar[k] = FALSE;
+        ticks->mudou_volta[k] = FALSE;
+    }
+    for (k = 0; k < n_posicoes; k++) {
+        ticks->reivindicacao[k] = SEM_REIVINDICACAO;
+    }
+
+    return ticks;
+}
+
+
+void free_ticks(ticks_t* ticks) {
+    pthread_barrier_destroy(&ticks->barreira);
+    free(ticks->i);
+    free(ticks->j);
+    free(ticks->velocidade);
+    free(ticks->espera);
+    free(ticks->tempo_gasto);
+    free(ticks->ativo);
+    free(ticks->proposta);
+    free(ticks->retirar);
+    free(ticks->mudou_volta);
+    free(ticks->reivindicacao);
+    free(ticks);
+}
+
+
+/**
+ * Reivindica uma posição para o k-ésimo ciclista. Se vários ciclistas quiserem a
+ * mesma posição, fica o de menor k, independentemente da ordem em que os workers
+ * chegarem aqui.
+ */
+void reivindicar(int* reivindicacao, int k) {
+    int atual;
+
+    atual = __atomic_load_n(reivindicacao, __ATOMIC_RELAXED);
+    while ((atual == SEM_REIVINDICACAO || k < atual) &&
+           !__atomic_compare_exchange_n(reivindicacao, &atual, k, TRUE,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+
+/**
+ * Primeira fase do tick: cada ciclista cujo intervalo terminou olha a pista – que
+ * ninguém altera nesta fase – e propõe para onde quer ir.
+ */
+void propor_movimentos(ticks_t* ticks, int inicio, int fim) {
+    simulacao_t* simulacao = ticks->simulacao;
+    int k, prox_i, prox_j;
+    ciclista_t* ciclista;
+
+    for (k = inicio; k < fim; k++) {
+        ticks->proposta[k] = VAZIA;
+        if (!ticks->ativo[k] || ticks->espera[k] > 0) continue;
+
+        ciclista = simulacao->ciclistas[k];
+        if (ciclista->quebrado || ciclista->eliminado) {
+            ticks->retirar[k] = TRUE;
+            continue;
+        }
+
+        if (proxima_posicao(simulacao, ticks->i[k], ticks->j[k], &prox_i, &prox_j)) {
+            ticks->proposta[k] = POSICAO(prox_i, prox_j);
+            reivindicar(&ticks->reivindicacao[ticks->proposta[k]], k);
+        }
+
+        ticks->espera[k] = passos_por_metro(simulacao, ticks->velocidade[k]);
+        ticks->tempo_gasto[k] += ticks->espera[k];
+    }
+}
+
+
+/**
+ * Segunda fase do tick: quem venceu a disputa pela posição proposta se move. Como
+ * cada posição tem no máximo um vencedor, e nenhuma posição proposta estava ocupada,
+ * ocupá-la sempre dá certo; só a máscara de ocupação de um mesmo metro é disputada
+ * entre os workers, e ela é atualizada atomicamente.
+ */
+void resolver_conflitos(ticks_t* ticks, int inicio, int fim) {
+    simulacao_t* simulacao = ticks->simulacao;
+    int k, destino, prox_i, prox_j;
+
+    for (k = inicio; k < fim; k++) {
+        destino = ticks->proposta[k];
+        if (destino == VAZIA) continue;
+        if (__atomic_load_n(&ticks->reivindicacao[destino], __ATOMIC_RELAXED) != k) continue;
+
+        __atomic_store_n(&ticks->reivindicacao[destino], SEM_REIVINDICACAO, __ATOMIC_RELAXED);
+        prox_i = destino / simulacao->faixas;
+        prox_j = destino % simulacao->faixas;
+        ocupar(simulacao, prox_i, prox_j, simulacao->ciclistas[k]->id);
+        desocupar(simulacao, ticks->i[k], ticks->j[k]);
+
+        ticks->mudou_volta[k] = (prox_i == 0 && ticks->i[k] == simulacao->d - 1);
+        ticks->i[k] = prox_i;
+        ticks->j[k] = prox_j;
+    }
+}
+
+
+/**
+ * Tira o k-ésimo ciclista da pista, registrando por quanto tempo ele correu.
+ */
+void retirar_em_ticks(ticks_t* ticks, int k) {
+    simulacao_t* simulacao = ticks->simulacao;
+    ciclista_t* ciclista;
+
+    ciclista = simulacao->ciclistas[k];
+    desocupar_sem_disputa(simulacao, ticks->i[k], ticks->j[k]);
+
+    ciclista->i = ticks->i[k];
+    ciclista->j = ticks->j[k];
+    ciclista->tempo_gasto = ticks->tempo_gasto[k] * (INTERVAL_PASSO / INTERVAL_1MS);
+    ticks->ativo[k] = FALSE;
+    ticks->retirar[k] = FALSE;
+}
+
+
+/**
+ * Última fase do tick, feita por um único worker: tudo o que mexe em rankings ou em
+ * outros ciclistas – voltas completadas, eliminações, quebras – acontece aqui, sempre
+ * na ordem dos ciclistas, para que o resultado não dependa de qual worker terminou
+ * primeiro.
+ */
+void fechar_tick(ticks_t* ticks) {
+    simulacao_t* simulacao = ticks->simulacao;
+    int k;
+    ciclista_t* ciclista;
+
+    for (k = 0; k < ticks->n; k++) {
+        if (ticks->retirar[k]) {
+            retirar_em_ticks(ticks, k);
+        } else if (ticks->mudou_volta[k]) {
+            ciclista = simulacao->ciclistas[k];
+            ciclista->i = ticks->i[k];
+            ciclista->j = ticks->j[k];
+            completar_volta(simulacao, ciclista);
+            ticks->velocidade[k] = ciclista->velocidade;
+            ticks->mudou_volta[k] = FALSE;
+        }
+        if (simulacao->trajetoria) {
+            gravar_trajetoria(simulacao->trajetoria, ticks->tick, k, ticks->i[k], ticks->j[k],
+                              km_por_hora(simulacao, ticks->velocidade[k]), ticks->ativo[k]);
+        }
+        ticks->espera[k]--;
+    }
+    ticks->tick++;
+
+    if (simulacao->depurar) {
+        desenhar_painel(simulacao);
+    }
+
+    ticks->fim = restantes_na_corrida(simulacao) == 0;
+}
+
+
+/**
+ * Laço de cada worker. Ele é responsável por uma fatia contínua dos ciclistas e
+ * avança junto com os demais, tick a tick, separado deles por barreiras.
+ */
+void* simular_worker(void* args) {
+    worker_t* worker = (worker_t*) args;
+    ticks_t* ticks = worker->ticks;
+    int inicio, fim;
+
+    inicio = (long) ticks->n * worker->id / ticks->n_workers;
+    fim = (long) ticks->n * (worker->id + 1) / ticks->n_workers;
+
+    while (!ticks->fim) {
+        propor_movimentos(ticks, inicio, fim);
+        pthread_barrier_wait(&ticks->barreira);
+
+        resolver_conflitos(ticks, inicio, fim);
+        pthread_barrier_wait(&ticks->barreira);
+
+        if (worker->id == 0) {
+            fechar_tick(ticks);
+        }
+        pthread_barrier_wait(&ticks->barreira);
+    }
+
+    return NULL;
+}
+
+
+/**
+ * Motor de ticks: um número fixo de workers avança a corrida em ticks de
+ * INTERVAL_PASSO. Em cada tick todos propõem seus movimentos em paralelo e só depois
+ * os conflitos são resolvidos, de modo que uma posição liberada num tick só pode ser
+ * ocupada no seguinte. O resultado depende apenas da semente, e não do número de
+ * workers nem do escalonamento do sistema.
+ */
+void simular_em_ticks(simulacao_t* simulacao, int n_workers) {
+    int k, t;
+    pthread_t* threads;
+    worker_t* workers;
+    ticks_t* ticks;
+
+    if (n_workers < 1) n_workers = 1;
+    if (n_workers > simulacao->n) n_workers = simulacao->n;
+
+    ticks = init_ticks(simulacao, n_workers);
+    threads = (pthread_t*) malloc(n_workers * sizeof(pthread_t));
+    workers = (worker_t*) malloc(n_workers * sizeof(worker_t));
+
+    for (t = 0; t < n_workers; t++) {
+        workers[t].id = t;
+        workers[t].ticks = ticks;
+        pthread_create(&threads[t], NULL, simular_worker, &workers[t]);
+    }
+    for (t = 0; t < n_workers; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    for (k = 0; k < ticks->n; k++) {
+        if (ticks->ativo[k]) {
+            retirar_em_ticks(ticks, k);
+            if (simulacao->trajetoria) {
+                gravar_trajetoria(simulacao->trajetoria, ticks->tick, k, ticks->i[k], ticks->j[k],
+                                  km_por_hora(simulacao, ticks->velocidade[k]), FALSE);
+            }
+        }
+    }
+    debug("Tempo simulado: %ldms\n", ticks->tick * (INTERVAL_PASSO / INTERVAL_1MS));
+
+    free(workers);
+    free(threads);
+    free_ticks(ticks);
+}
@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "ep2.h"
+#include "trajetoria.h"
+
+/**
+ * Gravador de trajetórias. A simulação só codifica as mudanças de cada tick em
+ * varints num bloco em memória; comprimir e escrever no disco fica com uma thread
+ * escritora, que recebe o bloco cheio enquanto a simulação já preenche o outro.
+ */
+struct info_trajetoria {
+    FILE* arquivo;
+    int n;
+    int d;
+    int* i;                     // último estado gravado de cada ciclista
+    int* j;
+    int* velocidade;
+    int* ativo;
+    long tick_anterior;         // tick do último registro fechado
+    long tick_atual;            // tick das mudanças acumuladas em `mudancas`
+    int k_anterior;
+    int n_mudancas;
+    unsigned char* mudancas;
+    size_t tam_mudancas;
+    size_t cap_mudancas;
+    unsigned char* bloco;       // preenchido pela simulação
+    size_t tam_bloco;
+    size_t cap_bloco;
+    unsigned char* entregue;    // com o escritor
+    size_t tam_entregue;
+    size_t cap_entregue;
+    int pendente;               // há um bloco entregue que ainda não foi escrito
+    int fim;
+    int erro;
+    pthread_t escritor;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+
+/**
+ * Garante espaço para mais `extra` bytes num buffer que cresce sob demanda.
+ */
+unsigned char* reservar(unsigned char* buffer, size_t tamanho, size_t* capacidade, size_t extra) {
+    if (tamanho + extra > *capacidade) {
+        *capacidade = 2 * (tamanho + extra);
+        buffer = (unsigned char*) realloc(buffer, *capacidade);
+    }
+    return buffer;
+}
+
+
+void* escrever_blocos(void* args) {
+    trajetoria_t* trajetoria = (trajetoria_t*) args;
+    unsigned char cabecalho[2 * MAX_VARINT];
+    unsigned char* comprimido = NULL;
+    uLongf capacidade = 0, tamanho;
+    size_t tam_cabecalho;
+
+    pthread_mutex_lock(&trajetoria->mutex);
+    for (;;) {
+        while (!trajetoria->pendente && !trajetoria->fim) {
+            pthread_cond_wait(&trajetoria->cond, &trajetoria->mutex);
+        }
+        if (!trajetoria->pendente) break;
+        pthread_mutex_unlock(&trajetoria->mutex);
+
+        /**
+         * Enquanto o bloco entregue está pendente, a simulação não toca nele, então
+         * ele pode ser comprimido fora da trava.
+         */
+        tamanho = compressBound(trajetoria->tam_entregue);
+        if (tamanho > capacidade) {
+            capacidade = tamanho;
+            comprimido = (unsigned char*) realloc(comprimido, capacidade);
+        }
+        if (compress2(comprimido, &tamanho, trajetoria->entregue, trajetoria->tam_entregue,
+                      Z_BEST_SPEED) != Z_OK) {
+            trajetoria->erro = TRUE;
+        } else {
+            tam_cabecalho = escrever_varint(cabecalho, trajetoria->tam_entregue);
+            tam_cabecalho += escrever_varint(cabecalho + tam_cabecalho, tamanho);
+            if (fwrite(cabecalho, 1, tam_cabecalho, trajetoria->arquivo) != tam_cabecalho ||
+                fwrite(comprimido, 1, tamanho, trajetoria->arquivo) != tamanho) {
+                trajetoria->erro = TRUE;
+            }
+        }
+
+        pthread_mutex_lock(&trajetoria->mutex);
+        trajetoria->pendente = FALSE;
+        pthread_cond_broadcast(&trajetoria->cond);
+    }
+    pthread_mutex_unlock(&trajetoria->mutex);
+
+    free(comprimido);
+    return NULL;
+}
+
+
+/**
+ * Passa o bloco atual para o escritor e continua num bloco vazio. Só espera se o
+ * escritor ainda não terminou o bloco anterior.
+ */
+void entregar_bloco(trajetoria_t* trajetoria) {
+    unsigned char* bloco;
+    size_t capacidade;
+
+    pthread_mutex_lock(&trajetoria->mutex);
+    while (trajetoria->pendente) {
+        pthread_cond_wait(&trajetoria->cond, &trajetoria->mutex);
+    }
+
+    bloco = trajetoria->entregue;
+    capacidade = trajetoria->cap_entregue;
+    trajetoria->entregue = trajetoria->bloco;
+    trajetoria->tam_entregue = trajetoria->tam_bloco;
+    trajetoria->cap_entregue = trajetoria->cap_bloco;
+    trajetoria->bloco = bloco;
+    trajetoria->tam_bloco = 0;
+    trajetoria->cap_bloco = capacidade;
+
+    trajetoria->pendente = TRUE;
+    pthread_cond_broadcast(&trajetoria->cond);
+    pthread_mutex_unlock(&trajetoria->mutex);
+}
+
+
+void acrescentar_varint(trajetoria_t* trajetoria, uint64_t valor) {
+    trajetoria->bloco = reservar(trajetoria->bloco, trajetoria->tam_bloco, &trajetoria->cap_bloco, MAX_VARINT);
+    trajetoria->tam_bloco += escrever_varint(trajetoria->bloco + trajetoria->tam_bloco, valor);
+}
+
+
+/**
+ * Fecha o registro do tick atual, passando as mudanças acumuladas para o bloco.
+ */
+void fechar_registro(trajetoria_t* trajetoria) {
+    if (trajetoria->n_mudancas == 0) return;
+
+    acrescentar_varint(trajetoria, trajetoria->tick_atual - trajetoria->tick_anterior);
+    acrescentar_varint(trajetoria, trajetoria->n_mudancas);
+    trajetoria->bloco = reservar(trajetoria->bloco, trajetoria->tam_bloco, &trajetoria->cap_bloco,
+                                 trajetoria->tam_mudancas);
+    memcpy(trajetoria->bloco + trajetoria->tam_bloco, trajetoria->mudancas, trajetoria->tam_mudancas);
+    trajetoria->tam_bloco += trajetoria->tam_mudancas;
+
+    trajetoria->tick_anterior = trajetoria->tick_atual;
+    trajetoria->k_anterior = -1;
+    trajetoria->n_mudancas = 0;
+    trajetoria->tam_mudancas = 0;
+
+    if (trajetoria->tam_bloco >= TAM_BLOCO_TRAJETORIA) {
+        entregar_bloco(trajetoria);
+    }
+}
+
+
+/**
+ * Cria o arquivo de trajetória da corrida, já com a largada, e põe o escritor para
+ * rodar. Devolve NULL se o arquivo não puder ser criado.
+ */
+trajetoria_t* init_trajetoria(simulacao_t* simulacao, const char* caminho) {
+    int k, n;
+    FILE* arquivo;
+    trajetoria_t* trajetoria;
+    ciclista_t* ciclista;
+
+    arquivo = fopen(caminho, "wb");
+    if (arquivo == NULL) {
+        fprintf(stderr, "Não foi possível criar o arquivo de trajetória %s\n", caminho);
+        return NULL;
+    }
+    fputs(MAGICA_TRAJETORIA, arquivo);
+    fputc(VERSAO_TRAJETORIA, arquivo);
+
+    n = simulacao->n;
+    trajetoria = (trajetoria_t*) calloc(1, sizeof(trajetoria_t));
+    trajetoria->arquivo = arquivo;
+    trajetoria->n = n;
+    trajetoria->d = simulacao->d;
+    trajetoria->i = (int*) malloc(n * sizeof(int));
+    trajetoria->j = (int*) malloc(n * sizeof(int));
+    trajetoria->velocidade = (int*) malloc(n * sizeof(int));
+    trajetoria->ativo = (int*) malloc(n * sizeof(int));
+    trajetoria->k_anterior = -1;
+    pthread_mutex_init(&trajetoria->mutex, NULL);
+    pthread_cond_init(&trajetoria->cond, NULL);
+
+    acrescentar_varint(trajetoria, simulacao->d);
+    acrescentar_varint(trajetoria, n);
+    acrescentar_varint(trajetoria, simulacao->faixas);
+    for (k = 0; k < n; k++) {
+        ciclista = simulacao->ciclistas[k];
+        trajetoria->i[k] = ciclista->i;
+        trajetoria->j[k] = ciclista->j;
+        trajetoria->velocidade[k] = km_por_hora(simulacao, ciclista->velocidade);
+        trajetoria->ativo[k] = TRUE;
+        acrescentar_varint(trajetoria, ciclista->id);
+        acrescentar_varint(trajetoria, ciclista->i);
+        acrescentar_varint(trajetoria, ciclista->j);
+        acrescentar_varint(trajetoria, trajetoria->velocidade[k]);
+    }
+
+    pthread_create(&trajetoria->escritor, NULL, escrever_blocos, trajetoria);
+
+    return trajetoria;
+}
+
+
+/**
+ * Informa o estado do k-ésimo ciclista no tick dado; só o que mudou desde a última
+ * chamada vai para o arquivo. Num mesmo tick, os ciclistas precisam ser informados
+ * em ordem crescente de k, e os ticks nunca voltam.
+ */
+void gravar_trajetoria(trajetoria_t* trajetoria, long tick, int k, int i, int j, int velocidade, int ativo) {
+    unsigned char* destino;
+    int marcas;
+    int di;
+
+    marcas = 0;
+    if (i != trajetoria->i[k] || j != trajetoria->j[k]) marcas |= MUDOU_POSICAO;
+    if (velocidade != trajetoria->velocidade[k]) marcas |= MUDOU_VELOCIDADE;
+    if (!ativo && trajetoria->ativo[k]) marcas |= SAIU_DA_PISTA;
+    if (!marcas) return;
+
+    if (tick != trajetoria->tick_atual) {
+        fechar_registro(trajetoria);
+        trajetoria->tick_atual = tick;
+    }
+
+    trajetoria->mudancas = reservar(trajetoria->mudancas, trajetoria->tam_mudancas,
+                                    &trajetoria->cap_mudancas, 5 * MAX_VARINT);
+    destino = trajetoria->mudancas + trajetoria->tam_mudancas;
+    destino += escrever_varint(destino, k - trajetoria->k_anterior - 1);
+    destino += escrever_varint(destino, marcas);
+    if (marcas & MUDOU_POSICAO) {
+        di = i - trajetoria->i[k];
+        if (di < 0) di += trajetoria->d;
+        destino += escrever_varint(destino, di);
+        destino += escrever_varint(destino, zigzag(j - trajetoria->j[k]));
+    }
+    if (marcas & MUDOU_VELOCIDADE) {
+        destino += escrever_varint(destino, zigzag(velocidade - trajetoria->velocidade[k]));
+    }
+    trajetoria->tam_mudancas = destino - trajetoria->mudancas;
+    trajetoria->n_mudancas++;
+    trajetoria->k_anterior = k;
+
+    trajetoria->i[k] = i;
+    trajetoria->j[k] = j;
+    trajetoria->velocidade[k] = velocidade;
+    trajetoria->ativo[k] = ativo;
+}
+
+
+/**
+ * Grava o que falta, espera o escritor terminar e fecha o arquivo. Devolve FALSE se
+ * alguma escrita falhou.
+ */
+int fechar_trajetoria(trajetoria_t* trajetoria) {
+    int ok;
+
+    fechar_registro(trajetoria);
+    if (trajetoria->tam_bloco > 0) {
+        entregar_bloco(trajetoria);
+    }
+
+    pthread_mutex_lock(&trajetoria->mutex);
+    trajetoria->fim = TRUE;
+    pthread_cond_broadcast(&trajetoria->cond);
+    pthread_mutex_unlock(&trajetoria->mutex);
+    pthread_join(trajetoria->escritor, NULL);
+
+    ok = fclose(trajetoria->arquivo) == 0 && !trajetoria->erro;
+    if (!ok) {
+        fprintf(stderr, "Não foi possível gravar a trajetória\n");
+    }
+
+    pthread_mutex_destroy(&trajetoria->mutex);
+    pthread_cond_destroy(&trajetoria->cond);
+    free(trajetoria->i);
+    free(trajetoria->j);
+    free(trajetoria->velocidade);
+    free(trajetoria->ativo);
+    free(trajetoria->mudancas);
+    free(trajetoria->bloco);
+    free(trajetoria->entregue);
+    free(trajetoria);
+
+    return ok;
+}
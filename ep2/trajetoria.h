@@ -0,0 +1,81 @@
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Formato do arquivo de trajetória, compartilhado pelo gravador (trajetoria.c) e pelo
+ * decodificador (reproduzir.c).
+ *
+ * O arquivo começa com MAGICA_TRAJETORIA e VERSAO_TRAJETORIA e segue com blocos
+ * comprimidos pelo zlib, cada um precedido pelo tamanho original e pelo tamanho
+ * comprimido, em varints. Descomprimidos e concatenados, os blocos formam um fluxo de
+ * varints:
+ *
+ *   d, n, faixas
+ *   para cada ciclista k: id, i, j, velocidade
+ *   para cada tick em que algo mudou:
+ *     ticks desde o registro anterior, número de mudanças
+ *     para cada mudança, em ordem crescente de k:
+ *       k - k anterior - 1, marcas
+ *       se MUDOU_POSICAO: (i - i anterior) mod d, j - j anterior (zigzag)
+ *       se MUDOU_VELOCIDADE: velocidade - velocidade anterior (zigzag)
+ *
+ * Os ticks são de INTERVAL_PASSO. Nenhum registro é partido entre dois blocos.
+ */
+#define MAGICA_TRAJETORIA "EP2T"
+#define VERSAO_TRAJETORIA 1
+
+#define MUDOU_POSICAO    1
+#define MUDOU_VELOCIDADE 2
+#define SAIU_DA_PISTA    4
+
+/**
+ * Tamanho a partir do qual um bloco é entregue ao escritor.
+ */
+#define TAM_BLOCO_TRAJETORIA 65536
+
+/**
+ * Maior número de bytes ocupado por um varint de 64 bits.
+ */
+#define MAX_VARINT 10
+
+
+static inline size_t escrever_varint(unsigned char* destino, uint64_t valor) {
+    size_t tamanho = 0;
+
+    while (valor >= 0x80) {
+        destino[tamanho++] = (unsigned char) (valor | 0x80);
+        valor >>= 7;
+    }
+    destino[tamanho++] = (unsigned char) valor;
+    return tamanho;
+}
+
+
+/**
+ * Lê um varint de origem, sem passar de fim. Devolve quantos bytes foram lidos, ou 0
+ * se o varint estiver truncado.
+ */
+static inline size_t ler_varint(const unsigned char* origem, const unsigned char* fim, uint64_t* valor) {
+    size_t tamanho = 0;
+    int deslocamento = 0;
+
+    *valor = 0;
+    while (origem + tamanho < fim && deslocamento < 64) {
+        *valor |= (uint64_t) (origem[tamanho] & 0x7f) << deslocamento;
+        if (!(origem[tamanho++] & 0x80)) return tamanho;
+        deslocamento += 7;
+    }
+    return 0;
+}
+
+
+/**
+ * Zigzag leva inteiros pequenos, positivos ou negativos, a varints pequenos.
+ */
+static inline uint64_t zigzag(int64_t valor) {
+    return ((uint64_t) valor << 1) ^ (uint64_t) (valor >> 63);
+}
+
+static inline int64_t desfazer_zigzag(uint64_t valor) {
+    return (int64_t) (valor >> 1) ^ -(int64_t) (valor & 1);
+}
@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "ep2.h"
+
+/**
+ * Modelo de velocidades, lido de um arquivo de texto com --velocidades. Linhas
+ * vazias e o que vem depois de # são ignorados; as demais são:
+ *
+ *   velocidades V1 V2 ...     velocidades possíveis, em km/h; um * depois de uma
+ *                             delas encerra o regime final quando alguém a alcança
+ *   largada V                 velocidade de todos na largada
+ *   final R                   o regime final vale enquanto restarem R ciclistas e
+ *                             ninguém tiver alcançado uma velocidade marcada com *
+ *   normal V: W1xP1 W2xP2 ... transições a partir de V fora do regime final
+ *   final V: W1xP1 W2xP2 ...  transições a partir de V no regime final
+ *
+ * Numa linha de transições, o sorteio de cada volta – um número de 0 a
+ * N_SORTEIOS - 1 – é repartido em faixas consecutivas: as P1 primeiras vão para W1,
+ * as P2 seguintes para W2, e assim por diante, até somar N_SORTEIOS. A mesma
+ * velocidade pode aparecer em mais de uma faixa. Quem não tem linha de transições
+ * num regime fica na mesma velocidade. A linha velocidades precisa vir antes das
+ * outras; sem a linha final R, não há regime final.
+ *
+ * O tempo para percorrer um metro a V km/h é arredondado para um número inteiro de
+ * passos de INTERVAL_PASSO, e esse é o intervalo usado por todos os motores.
+ *
+ * O modelo padrão é o de velocidades.txt, embutido como texto na compilação: o
+ * Makefile gera velocidades_padrao.h a partir dele.
+ */
+static const char* TEXTO_MODELO_PADRAO =
+#include "velocidades_padrao.h"
+    ;
+
+static modelo_t modelo_padrao_;
+static pthread_once_t modelo_padrao_lido = PTHREAD_ONCE_INIT;
+
+
+/**
+ * Índice de uma velocidade em km/h no modelo, ou -1 se ela não estiver nele.
+ */
+int indice_da_velocidade(modelo_t* modelo, int velocidade) {
+    int v;
+
+    for (v = 0; v < modelo->n_velocidades; v++) {
+        if (modelo->velocidades[v] == velocidade) return v;
+    }
+    return -1;
+}
+
+
+/**
+ * Lê as faixas de uma linha de transições e preenche a linha da tabela.
+ */
+int ler_transicoes(modelo_t* modelo, char* resto, unsigned char* linha) {
+    char *faixa, *posicao;
+    int sorteio, velocidade, quantidade, destino;
+
+    sorteio = 0;
+    for (faixa = strtok_r(resto, " \t\n", &posicao); faixa != NULL; faixa = strtok_r(NULL, " \t\n", &posicao)) {
+        if (sscanf(faixa, "%dx%d", &velocidade, &quantidade) != 2 || quantidade < 0 ||
+            sorteio + quantidade > N_SORTEIOS || (destino = indice_da_velocidade(modelo, velocidade)) < 0) {
+            return FALSE;
+        }
+        memset(linha + sorteio, destino, quantidade);
+        sorteio += quantidade;
+    }
+    return sorteio == N_SORTEIOS;
+}
+
+
+/**
+ * Lê as velocidades da linha `velocidades`.
+ */
+int ler_velocidades(modelo_t* modelo, char* resto) {
+    char *palavra, *posicao;
+    int velocidade, v;
+
+    if (modelo->n_velocidades) return FALSE;
+    for (palavra = strtok_r(resto, " \t\n", &posicao); palavra != NULL; palavra = strtok_r(NULL, " \t\n", &posicao)) {
+        if (modelo->n_velocidades == MAX_VELOCIDADES || (velocidade = atoi(palavra)) <= 0 ||
+            indice_da_velocidade(modelo, velocidade) >= 0) {
+            return FALSE;
+        }
+        v = modelo->n_velocidades++;
+        modelo->velocidades[v] = velocidade;
+        modelo->encerra_final[v] = strchr(palavra, '*') != NULL;
+    }
+    return modelo->n_velocidades > 0;
+}
+
+
+/**
+ * Interpreta uma linha do arquivo. Devolve FALSE se ela estiver mal formada.
+ */
+int ler_linha_do_modelo(modelo_t* modelo, char* linha) {
+    char *palavra, *resto, *posicao, extra;
+    int velocidade, v, regime;
+
+    if ((resto = strchr(linha, '#')) != NULL) *resto = '\0';
+    if ((palavra = strtok_r(linha, " \t\n", &posicao)) == NULL) return TRUE;
+    if ((resto = strtok_r(NULL, "\n", &posicao)) == NULL) return FALSE;
+
+    if (!strcmp(palavra, "velocidades")) {
+        return ler_velocidades(modelo, resto);
+    }
+    if (!strcmp(palavra, "largada")) {
+        if (sscanf(resto, "%d %c", &velocidade, &extra) != 1) return FALSE;
+        modelo->inicial = indice_da_velocidade(modelo, velocidade);
+        return modelo->inicial >= 0;
+    }
+    if (!strcmp(palavra, "final") && strchr(resto, ':') == NULL) {
+        return sscanf(resto, "%d %c", &modelo->restantes_final, &extra) == 1 && modelo->restantes_final > 0;
+    }
+
+    if (!strcmp(palavra, "normal")) {
+        regime = REGIME_NORMAL;
+    } else if (!strcmp(palavra, "final")) {
+        regime = REGIME_FINAL;
+    } else {
+        return FALSE;
+    }
+    if (sscanf(resto, "%d", &velocidade) != 1 || (v = indice_da_velocidade(modelo, velocidade)) < 0 ||
+        (resto = strchr(resto, ':')) == NULL) {
+        return FALSE;
+    }
+    return ler_transicoes(modelo, resto + 1, modelo->proxima[regime][v]);
+}
+
+
+/**
+ * Lê um modelo de um arquivo já aberto. `nome` só aparece nas mensagens de erro.
+ */
+int ler_modelo(modelo_t* modelo, FILE* arquivo, const char* nome) {
+    char linha[1024];
+    int numero, r, v;
+
+    memset(modelo, 0, sizeof(modelo_t));
+    modelo->inicial = -1;
+
+    /**
+     * Quem não tem linha de transições fica na mesma velocidade.
+     */
+    for (r = 0; r < N_REGIMES; r++) {
+        for (v = 0; v < MAX_VELOCIDADES; v++) {
+            memset(modelo->proxima[r][v], v, N_SORTEIOS);
+        }
+    }
+
+    for (numero = 1; fgets(linha, sizeof(linha), arquivo) != NULL; numero++) {
+        if (!ler_linha_do_modelo(modelo, linha)) {
+            fprintf(stderr, "%s:%d: linha inválida no modelo de velocidades\n", nome, numero);
+            return FALSE;
+        }
+    }
+    if (!modelo->n_velocidades || modelo->inicial < 0) {
+        fprintf(stderr, "%s: o modelo precisa das linhas velocidades e largada\n", nome);
+        return FALSE;
+    }
+
+    /**
+     * Um metro a V km/h leva 3600000 / V microssegundos.
+     */
+    for (v = 0; v < modelo->n_velocidades; v++) {
+        modelo->passos[v] = (3600000 / modelo->velocidades[v] + INTERVAL_PASSO / 2) / INTERVAL_PASSO;
+        if (modelo->passos[v] < 1) modelo->passos[v] = 1;
+        modelo->intervalos[v] = modelo->passos[v] * INTERVAL_PASSO;
+        if (modelo->passos[v] > modelo->max_passos) modelo->max_passos = modelo->passos[v];
+    }
+    return TRUE;
+}
+
+
+modelo_t* carregar_modelo(const char* caminho) {
+    FILE* arquivo;
+    modelo_t* modelo;
+
+    if ((arquivo = fopen(caminho, "r")) == NULL) {
+        fprintf(stderr, "Não foi possível abrir o modelo de velocidades %s\n", caminho);
+        return NULL;
+    }
+    modelo = (modelo_t*) malloc(sizeof(modelo_t));
+    if (!ler_modelo(modelo, arquivo, caminho)) {
+        free(modelo);
+        modelo = NULL;
+    }
+    fclose(arquivo);
+
+    return modelo;
+}
+
+
+void ler_modelo_padrao() {
+    FILE* arquivo;
+
+    arquivo = fmemopen((void*) TEXTO_MODELO_PADRAO, strlen(TEXTO_MODELO_PADRAO), "r");
+    if (arquivo == NULL || !ler_modelo(&modelo_padrao_, arquivo, "modelo padrão")) exit(1);
+    fclose(arquivo);
+}
+
+
+/**
+ * O modelo das regras originais: 30, 60 e 90 km/h, com a chance de 90 km/h quando
+ * restam três ciclistas. É lido uma só vez, por quem pedir primeiro.
+ */
+modelo_t* modelo_padrao() {
+    pthread_once(&modelo_padrao_lido, ler_modelo_padrao);
+    return &modelo_padrao_;
+}
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <pthread.h>
+#include "ep2.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TEM_AVX2_NA_ARQUITETURA 1
+#endif
+
+/**
+ * Núcleo vetorial do motor de passos. A cada passo, todos os ciclistas têm a espera
+ * decrementada e só os que ficaram prontos – ainda na pista e sem espera – precisam
+ * do tratamento escalar de movimento, volta e quebra. Esse laço sobre todos os n
+ * ciclistas é feito aqui de uma vez, sobre os vetores do motor, e devolve a lista
+ * compacta dos prontos em ordem crescente de k, que é a ordem em que o motor os
+ * move.
+ *
+ * Há duas versões com o mesmo resultado: uma escalar, que serve em qualquer
+ * máquina, e uma com AVX2, que trata oito ciclistas por instrução. A versão é
+ * escolhida na primeira chamada, conforme o processador.
+ */
+
+static coletor_t coletor_escolhido;
+static pthread_once_t coletor_foi_escolhido = PTHREAD_ONCE_INIT;
+
+
+int coletar_prontos_escalar(int* espera, const int* ativo, int n, int decremento, int* prontos) {
+    int k, n_prontos;
+
+    n_prontos = 0;
+    for (k = 0; k < n; k++) {
+        espera[k] -= decremento;
+        if (ativo[k] && espera[k] <= 0) prontos[n_prontos++] = k;
+    }
+    return n_prontos;
+}
+
+
+#ifdef TEM_AVX2_NA_ARQUITETURA
+
+__attribute__((target("avx2")))
+int coletar_prontos_avx2(int* espera, const int* ativo, int n, int decremento, int* prontos) {
+    __m256i dec, um, zero, e, a, pronto;
+    int k, n_prontos, mascara;
+
+    dec = _mm256_set1_epi32(decremento);
+    um = _mm256_set1_epi32(1);
+    zero = _mm256_setzero_si256();
+
+    n_prontos = 0;
+    for (k = 0; k + 8 <= n; k += 8) {
+        e = _mm256_sub_epi32(_mm256_loadu_si256((__m256i*) (espera + k)), dec);
+        _mm256_storeu_si256((__m256i*) (espera + k), e);
+        a = _mm256_loadu_si256((const __m256i*) (ativo + k));
+
+        /**
+         * Pronto é espera < 1 e ativo != 0; a máscara tem um bit por ciclista, e os
+         * prontos costumam ser poucos, então percorrê-la bit a bit é barato.
+         */
+        pronto = _mm256_andnot_si256(_mm256_cmpeq_epi32(a, zero), _mm256_cmpgt_epi32(um, e));
+        mascara = _mm256_movemask_ps(_mm256_castsi256_ps(pronto));
+        while (mascara) {
+            prontos[n_prontos++] = k + __builtin_ctz(mascara);
+            mascara &= mascara - 1;
+        }
+    }
+    for (; k < n; k++) {
+        espera[k] -= decremento;
+        if (ativo[k] && espera[k] <= 0) prontos[n_prontos++] = k;
+    }
+    return n_prontos;
+}
+
+#endif
+
+
+/**
+ * O coletor AVX2 quando o processador tem AVX2, ou NULL.
+ */
+coletor_t coletor_avx2() {
+#ifdef TEM_AVX2_NA_ARQUITETURA
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return coletar_prontos_avx2;
+#endif
+    return NULL;
+}
+
+
+void escolher_coletor() {
+    coletor_escolhido = coletor_avx2();
+    if (coletor_escolhido == NULL) coletor_escolhido = coletar_prontos_escalar;
+}
+
+
+/**
+ * Subtrai `decremento` da espera de todos os n ciclistas e põe em prontos os k dos
+ * que estão ativos e ficaram sem espera. Devolve quantos são.
+ */
+int coletar_prontos(int* espera, const int* ativo, int n, int decremento, int* prontos) {
+    pthread_once(&coletor_foi_escolhido, escolher_coletor);
+    return coletor_escolhido(espera, ativo, n, decremento, prontos);
+}
@@ -1,9 +1,14 @@
+#include <cctype>
 #include <cstring>
 #include <ctime>
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /**
  * Capacidade máxima do filesystem.
@@ -21,20 +26,57 @@
 #define BLOCK_SIZE 4000
 
 /**
- * Número de blocos ocupados pelo bitmap.
+ * Número de blocos ocupados pelo bitmap no formato ASCII.
  */
 #define BITMAP_SIZE 7
 
 /**
- * Número de blocos ocupados pela tabela FAT.
+ * Número de blocos ocupados pela tabela FAT no formato ASCII.
  */
 #define FAT_SIZE 32
 
 /**
- * Representa o primeiro bloco disponível para uso no sistema.
+ * Representa o primeiro bloco disponível para uso no formato ASCII.
  */
 #define INITIAL_BLOCK (BITMAP_SIZE + FAT_SIZE)
 
+/**
+ * Assinatura no início do superbloco das imagens no formato binário. Uma imagem que
+ * não começa por ela está no formato ASCII original.
+ */
+#define FS_MAGIC "EP3B"
+
+/**
+ * Versão do formato binário gravada no superbloco.
+ */
+#define FS_VERSION 1
+
+/**
+ * Formatos de imagem reconhecidos pelo mount.
+ */
+#define FORMAT_ASCII 0
+#define FORMAT_BINARY 1
+
+/**
+ * No formato binário, o bloco 0 guarda o superbloco, seguido pelo bitmap, com um bit
+ * por bloco, e pela tabela FAT, com um inteiro de 32 bits little-endian por bloco.
+ * Cada bloco i ocupa os bytes a partir de i * BLOCK_SIZE.
+ */
+#define BINARY_BITMAP_START 1
+#define BINARY_BITMAP_SIZE (((MAX_BLOCKS + 7) / 8 + BLOCK_SIZE - 1) / BLOCK_SIZE)
+#define BINARY_FAT_START (BINARY_BITMAP_START + BINARY_BITMAP_SIZE)
+#define BINARY_FAT_SIZE ((4 * MAX_BLOCKS + BLOCK_SIZE - 1) / BLOCK_SIZE)
+
+/**
+ * Representa o primeiro bloco disponível para uso numa imagem binária nova.
+ */
+#define BINARY_INITIAL_BLOCK (BINARY_FAT_START + BINARY_FAT_SIZE)
+
+/**
+ * Número de bytes mapeados em memória para uma imagem: todos os seus blocos.
+ */
+#define IMAGE_SIZE ((size_t) MAX_BLOCKS * BLOCK_SIZE)
+
 /**
  * Tamanho máximo que um nome de arquivo pode ter.
  */
@@ -104,16 +146,38 @@ typedef struct vdir_t{
 /**
  * Representa o sistema de arquivos propriamente dito, incluindo tabela FAT,
  * o bitmap representando os blocos livres/usados e o arquivo no sistema físico
- * onde nossa abstração vai ser armazenada.
+ * onde nossa abstração vai ser armazenada. Os blocos não são copiados para a memória:
+ * `image` mapeia todos eles, e cada bloco é lido e escrito ali mesmo. Numa imagem
+ * binária, o mapeamento é o próprio arquivo; numa imagem ASCII, cujos blocos não têm
+ * posição fixa no arquivo, é memória anônima preenchida no mount.
  */
  typedef struct {
-   fstream file;
+   int fd;
+   char* image;
+   int format;
+   int first_data_block;
    int fat[MAX_BLOCKS];
    int bitmap[MAX_BLOCKS];
-   string blocks[MAX_BLOCKS];
  } filesystem_t;
 
 
+/**
+ * Campos do superbloco do formato binário, gravados logo após FS_MAGIC, cada um como
+ * um inteiro de 32 bits little-endian. Imagens convertidas do formato ASCII mantêm a
+ * numeração dos blocos, então o primeiro bloco de dados fica registrado aqui.
+ */
+typedef struct {
+  int version;
+  int block_size;
+  int n_blocks;
+  int bitmap_start;
+  int bitmap_size;
+  int fat_start;
+  int fat_size;
+  int first_data_block;
+} superblock_t;
+
+
 /**
  * Abstrai um comando para o sistema de arquivo, separando comando built-in
  * dos seus argumentos.
@@ -129,94 +193,235 @@ filesystem_t fs;
 
 
 /**
- * Diz se o arquivo lido está vazio comparando o número de bytes da atual posição.
- * OBS: depende de a posição atual corresponder ao final do arquivo.
+ * Diz se o arquivo da imagem está vazio.
  */
 bool is_fs_empty() {
-  return fs.file.tellg() <= 0;
+  struct stat info;
+
+  return fstat(fs.fd, &info) != 0 || info.st_size == 0;
 }
 
 
 /**
- * Inicializa o bitmap dentro do blocos que o armazenariam no filesystem simulado. Isso torna
- * mais fácil a posterior serialização desses dados para o arquivo real.
+ * Devolve o tamanho, em bytes, do arquivo da imagem.
  */
-void write_bitmap_to_blocks() {
-  int i, j, k;
-  string serialized;
+off_t fs_file_size() {
+  struct stat info;
 
-  i = j = k = 0;
-  serialized = "";
+  if (fstat(fs.fd, &info) != 0) {
+    throw "Não foi possível consultar o tamanho da imagem!";
+  }
+  return info.st_size;
+}
 
-  while (i < MAX_BLOCKS) {
-    if (j == BLOCK_SIZE) {
-      fs.blocks[k] = serialized;
-      serialized = "";
-      j = 0;
-      k++;
-    }
-    serialized.append(to_string(fs.bitmap[i]));
-    i++;
-    j++;
+
+/**
+ * Grava um inteiro de 32 bits em little-endian, independentemente da arquitetura.
+ */
+void put_int32(char* bytes, int value) {
+  for (int i = 0; i < 4; i++) {
+    bytes[i] = (char) ((unsigned int) value >> (8 * i));
   }
+}
 
-  /**
-   * Completa o bloco restante com um caracter arbitrário até que atinja BLOCK_SIZE bytes.
-   */
-  for (j = j; j < BLOCK_SIZE; j++) {
-    serialized.append("@");
+
+/**
+ * Lê um inteiro de 32 bits gravado em little-endian.
+ */
+int get_int32(const char* bytes) {
+  unsigned int value = 0;
+
+  for (int i = 0; i < 4; i++) {
+    value |= (unsigned int) (unsigned char) bytes[i] << (8 * i);
   }
-  fs.blocks[k] = serialized;
+  return (int) value;
 }
 
 
 /**
- * Inicializa a tabela FAT dentro do blocos que o armazenariam no filesystem simulado.
- * Isso torna mais fácil a posterior serialização desses dados para o arquivo real.
+ * Devolve o início do bloco i dentro da imagem mapeada. Todo bloco ocupa BLOCK_SIZE
+ * bytes, e o seu conteúdo vai até o primeiro '\0'.
  */
-void write_fat_to_blocks() {
-  int i, j, k;
-  char number_repr[6];
-  string serialized;
+char* block_at(int i) {
+  return fs.image + (size_t) i * BLOCK_SIZE;
+}
 
-  i = j = 0;
-  k = BITMAP_SIZE;
 
-  /**
-   * Aqui opta-se por serializar todos os endereços com largura fixa de 5 caracteres. Isso
-   * facilita durante o parsing.
-   */
-  while (i < MAX_BLOCKS) {
-    if (j == BLOCK_SIZE) {
-      fs.blocks[k] = serialized;
-      serialized = "";
-      j = 0;
-      k++;
-    }
-    sprintf(number_repr, "%05d", fs.fat[i]);
-    serialized.append(string(number_repr));
-    i++;
-    j += 5;
+/**
+ * Número de bytes de conteúdo do bloco i.
+ */
+size_t block_length(int i) {
+  return strnlen(block_at(i), BLOCK_SIZE);
+}
+
+
+/**
+ * Substitui o conteúdo do bloco i, completando-o com '\0'. O que passar de
+ * BLOCK_SIZE bytes é descartado.
+ */
+void write_block(int i, const string& content) {
+  size_t length;
+
+  length = content.size() < BLOCK_SIZE ? content.size() : BLOCK_SIZE;
+  memcpy(block_at(i), content.data(), length);
+  memset(block_at(i) + length, 0, BLOCK_SIZE - length);
+}
+
+
+/**
+ * Esvazia o bloco i.
+ */
+void clear_block(int i) {
+  memset(block_at(i), 0, BLOCK_SIZE);
+}
+
+
+/**
+ * Mapeia todos os blocos da imagem. Com `shared`, o mapeamento é o próprio arquivo, e o
+ * que for escrito nos blocos vai para ele; sem, é memória anônima zerada. Em ambos os
+ * casos, só as páginas efetivamente tocadas passam a ocupar memória.
+ * @throw quando o mapeamento falha.
+ */
+void map_image(bool shared) {
+  void* image;
+
+  if (shared) {
+    image = mmap(NULL, IMAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fs.fd, 0);
+  } else {
+    image = mmap(NULL, IMAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  }
+  if (image == MAP_FAILED) {
+    throw "Não foi possível mapear a imagem em memória!";
   }
+  fs.image = (char*) image;
+}
 
-  /**
-   * Completa o bloco restante com um caracter arbitrário até que atinja BLOCK_SIZE bytes.
-   */
-  for (j = j; j < BLOCK_SIZE; j++) {
-    serialized.append("@");
+
+/**
+ * Estende o arquivo da imagem até IMAGE_SIZE bytes, para que todo bloco mapeado exista
+ * nele. Os blocos acrescentados não ocupam disco enquanto não forem escritos.
+ * @throw quando o arquivo não pode ser estendido.
+ */
+void extend_image() {
+  if (fs_file_size() < (off_t) IMAGE_SIZE && ftruncate(fs.fd, IMAGE_SIZE) != 0) {
+    throw "Não foi possível estender a imagem!";
   }
-  fs.blocks[k] = serialized;
 }
 
 
 /**
- * Serializa os blocos dentro do arquivo real que representa o filesystem.
+ * Desfaz o mapeamento e fecha o arquivo da imagem.
  */
-void write_blocks_to_fs() {
-  fs.file.seekp(ios::beg);
+void close_fs() {
+  if (fs.image != NULL) {
+    munmap(fs.image, IMAGE_SIZE);
+    fs.image = NULL;
+  }
+  close(fs.fd);
+}
 
+
+/**
+ * Número de bytes que a imagem binária precisa ter para guardar os metadados e todos os
+ * blocos em uso.
+ */
+size_t image_extent() {
+  int last;
+
+  last = fs.first_data_block - 1;
+  for (int i = MAX_BLOCKS - 1; i >= fs.first_data_block; i--) {
+    if (fs.bitmap[i] == 0) {
+      last = i;
+      break;
+    }
+  }
+  return (size_t) (last + 1) * BLOCK_SIZE;
+}
+
+
+/**
+ * Grava nos primeiros blocos da imagem mapeada o superbloco, o bitmap e a FAT do
+ * formato binário.
+ */
+void write_metadata_to_blocks() {
+  superblock_t superblock;
+  char *header, *bitmap, *fat;
+
+  superblock.version = FS_VERSION;
+  superblock.block_size = BLOCK_SIZE;
+  superblock.n_blocks = MAX_BLOCKS;
+  superblock.bitmap_start = BINARY_BITMAP_START;
+  superblock.bitmap_size = BINARY_BITMAP_SIZE;
+  superblock.fat_start = BINARY_FAT_START;
+  superblock.fat_size = BINARY_FAT_SIZE;
+  superblock.first_data_block = fs.first_data_block;
+
+  header = block_at(0);
+  memset(header, 0, BINARY_INITIAL_BLOCK * BLOCK_SIZE);
+  memcpy(header, FS_MAGIC, 4);
+  put_int32(header + 4, superblock.version);
+  put_int32(header + 8, superblock.block_size);
+  put_int32(header + 12, superblock.n_blocks);
+  put_int32(header + 16, superblock.bitmap_start);
+  put_int32(header + 20, superblock.bitmap_size);
+  put_int32(header + 24, superblock.fat_start);
+  put_int32(header + 28, superblock.fat_size);
+  put_int32(header + 32, superblock.first_data_block);
+
+  bitmap = block_at(BINARY_BITMAP_START);
+  fat = block_at(BINARY_FAT_START);
   for (int i = 0; i < MAX_BLOCKS; i++) {
-    fs.file << fs.blocks[i];
+    if (fs.bitmap[i] == 1) {
+      bitmap[i / 8] |= (char) (1 << (i % 8));
+    }
+    put_int32(fat + 4 * i, fs.fat[i]);
+  }
+}
+
+
+/**
+ * Serializa os blocos no formato ASCII, concatenando-os a partir do início do arquivo.
+ * @throw quando a escrita falha.
+ */
+void write_ascii_fs() {
+  off_t offset;
+  size_t length;
+
+  offset = 0;
+  for (int i = 0; i < MAX_BLOCKS; i++) {
+    length = block_length(i);
+    if (pwrite(fs.fd, block_at(i), length, offset) != (ssize_t) length) {
+      throw "Não foi possível gravar a imagem!";
+    }
+    offset += length;
+  }
+}
+
+
+/**
+ * Conclui a escrita de uma imagem binária. Os blocos de dados já estão no arquivo, pelo
+ * mapeamento; falta gravar os metadados e encurtar o arquivo, que o mount estendeu até
+ * IMAGE_SIZE, para terminar no último bloco em uso.
+ * @throw quando a escrita falha.
+ */
+void write_binary_fs() {
+  write_metadata_to_blocks();
+
+  if (msync(fs.image, IMAGE_SIZE, MS_SYNC) != 0 || ftruncate(fs.fd, image_extent()) != 0) {
+    throw "Não foi possível gravar a imagem!";
+  }
+}
+
+
+/**
+ * Serializa os blocos dentro do arquivo real que representa o filesystem, no formato
+ * em que ele foi montado.
+ */
+void write_blocks_to_fs() {
+  if (fs.format == FORMAT_BINARY) {
+    write_binary_fs();
+  } else {
+    write_ascii_fs();
   }
 }
 
@@ -226,7 +431,7 @@ void write_blocks_to_fs() {
  * @throw quando não há espaço disponível.
  */
 int find_empty_block() {
-  for (int i = INITIAL_BLOCK; i < MAX_BLOCKS; i++) {
+  for (int i = fs.first_data_block; i < MAX_BLOCKS; i++) {
     if (fs.bitmap[i] == '1') {
       return i;
     }
@@ -272,8 +477,6 @@ void update_dir_block(int position, vdir_t dir) {
   char head[6];
   char name[NAME_SIZE];
 
-  fs.file.seekp(position, ios::beg);
-
   debug("block", position / BLOCK_SIZE);
   debug("will write children", dir.children.size());
 
@@ -304,7 +507,7 @@ void update_dir_block(int position, vdir_t dir) {
 
   fs.bitmap[position] = 0;
   fs.fat[position] = -1;
-  fs.blocks[position] = new_block;
+  write_block(position, new_block);
 }
 
 
@@ -315,7 +518,7 @@ void init_root_dir() {
   int root_pos;
 
   now = time(nullptr);
-  root_pos = INITIAL_BLOCK;
+  root_pos = fs.first_data_block;
 
   root_attrs.created = now;
   root_attrs.last_access = now;
@@ -336,39 +539,86 @@ void init_root_dir() {
 
 
 /**
- * Inicializa um filesystem vazio no arquivo apontado em fs. Isso inclui escrever lá
- * um bitmap vazio, uma quase–vazia tabela fat e os metadados do diretório /
+ * Inicializa um filesystem vazio, no formato binário, no arquivo apontado em fs, já
+ * mapeado. Isso inclui um bitmap em que só os blocos de metadados estão ocupados, uma
+ * quase–vazia tabela fat e os metadados do diretório /
  */
 void init_empty_fs() {
+  fs.format = FORMAT_BINARY;
+  fs.first_data_block = BINARY_INITIAL_BLOCK;
+
   for (int i = 0; i < MAX_BLOCKS; i++) {
-    fs.bitmap[i] = 1;
+    fs.bitmap[i] = i < fs.first_data_block ? 0 : 1;
     fs.fat[i] = -1;
-    fs.blocks[i] = "";
   }
 
-  write_bitmap_to_blocks();
-  write_fat_to_blocks();
   init_root_dir();
+
+  /**
+   * O arquivo acabou de ser estendido; sem os metadados gravados já aqui, uma sessão
+   * encerrada sem unmount o deixaria sem superbloco, e o próximo mount o tomaria por
+   * uma imagem ASCII.
+   */
+  write_metadata_to_blocks();
+  if (msync(fs.image, IMAGE_SIZE, MS_SYNC) != 0) {
+    throw "Não foi possível gravar a imagem!";
+  }
+}
+
+
+/**
+ * Diz se `serialized` é um endereço da FAT no formato ASCII: cinco caracteres, todos
+ * dígitos, exceto o primeiro, que pode ser o sinal de -1.
+ */
+bool is_ascii_fat_entry(const char* serialized) {
+  if (strlen(serialized) != 5) return false;
+
+  for (int i = 0; i < 5; i++) {
+    if (!isdigit((unsigned char) serialized[i]) && !(i == 0 && serialized[i] == '-')) {
+      return false;
+    }
+  }
+  return true;
 }
 
 
 /**
- * Interpreta um filesystem já existente, colocando em memória o seu conteúdo.
+ * Interpreta um filesystem no formato ASCII, em `path`, copiando os seus blocos para a
+ * imagem mapeada.
+ * @throw quando o arquivo é curto demais ou o bitmap e a FAT não estão no formato.
  */
-void parse_fs() {
+void parse_ascii_fs(string path) {
+  ifstream file;
   char bit;
   char serialized[6];
   char block[BLOCK_SIZE + 1];
 
-  fs.file.seekg(ios::beg);
+  fs.format = FORMAT_ASCII;
+  fs.first_data_block = INITIAL_BLOCK;
+
+  if (fs_file_size() < (off_t) INITIAL_BLOCK * BLOCK_SIZE) {
+    throw "A imagem é curta demais para o formato ASCII!";
+  }
+
+  file.open(path, ios::in | ios::binary);
+  if (!file.is_open()) {
+    throw "Não foi possível abrir a imagem ASCII!";
+  }
+
   for (int i = 0; i < MAX_BLOCKS; i++) {
-    bit = fs.file.get();
+    bit = file.get();
+    if (!isdigit((unsigned char) bit)) {
+      throw "Bitmap inválido na imagem ASCII!";
+    }
     fs.bitmap[i] = (int) bit-'0';
   }
 
-  fs.file.seekg(BITMAP_SIZE * BLOCK_SIZE, ios::beg);
+  file.seekg(BITMAP_SIZE * BLOCK_SIZE, ios::beg);
   for (int i = 0; i < MAX_BLOCKS; i++) {
-    fs.file.get(serialized, 6);
+    file.get(serialized, 6);
+    if (!is_ascii_fat_entry(serialized)) {
+      throw "Tabela FAT inválida na imagem ASCII!";
+    }
     fs.fat[i] = stoi(serialized);
   }
 
@@ -376,10 +626,89 @@ void parse_fs() {
    * Volta ao início do arquivo para ler todos os blocos, inclusive, aqueles
    * pertencentes ao bitmap e à tabela FAT.
    */
-  fs.file.seekg(ios::beg);
+  file.seekg(ios::beg);
+  for (int i = 0; i < MAX_BLOCKS; i++) {
+    file.get(block, BLOCK_SIZE+1);
+    write_block(i, string(block));
+  }
+}
+
+
+/**
+ * Interpreta um filesystem no formato binário, já mapeado. Só o superbloco, o bitmap e a
+ * FAT são lidos; os blocos de dados ficam no mapeamento até serem usados.
+ * @throw quando o superbloco descreve um formato diferente do suportado.
+ */
+void parse_binary_fs() {
+  superblock_t superblock;
+  const char *header, *bitmap, *fat;
+
+  if (fs_file_size() < (off_t) BINARY_INITIAL_BLOCK * BLOCK_SIZE) {
+    throw "Imagem binária truncada!";
+  }
+
+  header = block_at(0);
+  superblock.version = get_int32(header + 4);
+  superblock.block_size = get_int32(header + 8);
+  superblock.n_blocks = get_int32(header + 12);
+  superblock.bitmap_start = get_int32(header + 16);
+  superblock.bitmap_size = get_int32(header + 20);
+  superblock.fat_start = get_int32(header + 24);
+  superblock.fat_size = get_int32(header + 28);
+  superblock.first_data_block = get_int32(header + 32);
+
+  if (superblock.version != FS_VERSION) {
+    throw "Versão da imagem binária não suportada!";
+  }
+  if (superblock.block_size != BLOCK_SIZE || superblock.n_blocks != MAX_BLOCKS ||
+      superblock.bitmap_start != BINARY_BITMAP_START || superblock.bitmap_size != BINARY_BITMAP_SIZE ||
+      superblock.fat_start != BINARY_FAT_START || superblock.fat_size != BINARY_FAT_SIZE ||
+      superblock.first_data_block < BINARY_INITIAL_BLOCK || superblock.first_data_block >= MAX_BLOCKS) {
+    throw "Superbloco com geometria diferente da suportada!";
+  }
+
+  fs.format = FORMAT_BINARY;
+  fs.first_data_block = superblock.first_data_block;
+
+  bitmap = block_at(BINARY_BITMAP_START);
+  fat = block_at(BINARY_FAT_START);
   for (int i = 0; i < MAX_BLOCKS; i++) {
-    fs.file.get(block, BLOCK_SIZE+1);
-    fs.blocks[i] = string(block);
+    fs.bitmap[i] = (bitmap[i / 8] >> (i % 8)) & 1;
+    fs.fat[i] = get_int32(fat + 4 * i);
+  }
+
+  /**
+   * O arquivo termina no último bloco em uso; os demais passam a existir nele, e são
+   * lidos como '\0', assim que a imagem é estendida.
+   */
+  extend_image();
+}
+
+
+/**
+ * Diz em que formato está a imagem aberta em fs, pela assinatura no início do arquivo.
+ */
+int fs_format() {
+  char magic[4];
+
+  if (pread(fs.fd, magic, 4, 0) == 4 && memcmp(magic, FS_MAGIC, 4) == 0) {
+    return FORMAT_BINARY;
+  }
+  return FORMAT_ASCII;
+}
+
+
+/**
+ * Interpreta um filesystem já existente, em `path`. Uma imagem binária é mapeada
+ * diretamente; uma ASCII é copiada para memória anônima.
+ */
+void parse_fs(string path) {
+  if (fs_format() == FORMAT_BINARY) {
+    map_image(true);
+    parse_binary_fs();
+  } else {
+    map_image(false);
+    parse_ascii_fs(path);
   }
 }
 
@@ -390,22 +719,27 @@ void parse_fs() {
  */
 void mount(cmd_t command) {
   /**
-   * Garante que o filesystem simulado sempre vai existir por, inicialmente, tentar
-   * abri-lo em modo append – o que o acaba criando, caso ele não exista.
+   * Garante que o filesystem simulado sempre vai existir, criando-o caso ele não
+   * exista.
    */
-  fs.file.open(command.args[0], ios::out | ios::app);
-  fs.file.close();
-  fs.file.open(command.args[0], ios::in | ios::out | ios::ate);
+  fs.fd = open(command.args[0].c_str(), O_RDWR | O_CREAT, 0644);
 
-  if (!fs.file.is_open()) {
+  if (fs.fd < 0) {
     cout << "Não foi possível abrir " << command.args[0] << endl;
     exit(1);
   }
 
-  if (is_fs_empty()) {
-    init_empty_fs();
-  } else {
-    parse_fs();
+  try {
+    if (is_fs_empty()) {
+      map_image(true);
+      extend_image();
+      init_empty_fs();
+    } else {
+      parse_fs(command.args[0]);
+    }
+  } catch (const char*) {
+    close_fs();
+    throw;
   }
 }
 
@@ -415,7 +749,84 @@ void mount(cmd_t command) {
  */
 void unmount(cmd_t command) {
   write_blocks_to_fs();
-  fs.file.close();
+  close_fs();
+}
+
+
+/**
+ * Converte a imagem no formato ASCII em command.args[0] para uma imagem no formato
+ * binário em command.args[1]. A numeração dos blocos é mantida, então os dados da
+ * imagem convertida continuam começando em INITIAL_BLOCK, e os blocos antes dele, que
+ * guardavam o bitmap e a FAT em ASCII, ficam reservados.
+ * @throw quando há um filesystem montado ou as imagens não podem ser usadas.
+ */
+void convert(cmd_t command) {
+  int output;
+  size_t extent;
+  bool written;
+
+  if (command.args.size() != 2) {
+    throw "Uso: convert <imagem ASCII> <imagem binária>";
+  }
+  if (fs.image != NULL) {
+    throw "Desmonte o filesystem antes de converter uma imagem!";
+  }
+
+  fs.fd = open(command.args[0].c_str(), O_RDONLY);
+  if (fs.fd < 0) {
+    throw "Não foi possível abrir a imagem a converter!";
+  }
+  try {
+    if (fs_format() != FORMAT_ASCII) {
+      throw "A imagem já está no formato binário!";
+    }
+    map_image(false);
+    parse_ascii_fs(command.args[0]);
+  } catch (const char*) {
+    close_fs();
+    throw;
+  }
+  close(fs.fd);
+
+  /**
+   * O bitmap ASCII só é gravado na criação da imagem e pode não marcar blocos que têm
+   * conteúdo; para não perder dados, esses também passam a constar como usados.
+   */
+  for (int i = 0; i < MAX_BLOCKS; i++) {
+    if (i < fs.first_data_block || block_length(i) > 0) {
+      fs.bitmap[i] = 0;
+    }
+  }
+  fs.format = FORMAT_BINARY;
+  write_metadata_to_blocks();
+
+  /**
+   * A imagem convertida está em memória anônima, então vai para o arquivo de saída bloco
+   * a bloco: os metadados e os blocos de dados em uso, cada um na sua posição.
+   */
+  output = open(command.args[1].c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (output < 0) {
+    munmap(fs.image, IMAGE_SIZE);
+    fs.image = NULL;
+    throw "Não foi possível criar a imagem convertida!";
+  }
+
+  extent = image_extent();
+  written = true;
+  for (int i = 0; (size_t) i * BLOCK_SIZE < extent; i++) {
+    if (i < BINARY_INITIAL_BLOCK || (i >= fs.first_data_block && fs.bitmap[i] == 0)) {
+      written = written && pwrite(output, block_at(i), BLOCK_SIZE, (off_t) i * BLOCK_SIZE) == BLOCK_SIZE;
+    }
+  }
+  written = written && ftruncate(output, extent) == 0;
+
+  close(output);
+  munmap(fs.image, IMAGE_SIZE);
+  fs.image = NULL;
+
+  if (!written) {
+    throw "Não foi possível gravar a imagem convertida!";
+  }
 }
 
 
@@ -427,7 +838,7 @@ void cp (cmd_t command){
   vattr_t copy;
   vdir_t* dir;
   string aux, arquivo="", pai;
-  int i, pos, count;
+  int i, pos, count, offset;
 
   /*dir é o diretorio aonde o arquivo vai ser guardado e arquivo é o nome do arquivo.*/
   dir= root;
@@ -453,7 +864,7 @@ void cp (cmd_t command){
       arq.head = i;
       fs.bitmap[i]=0;
       pos = i;
-      fs.blocks[i].clear();
+      clear_block(i);
       break;
     }
   }
@@ -466,16 +877,18 @@ void cp (cmd_t command){
   if(file.is_open()){
     char c;
     count = 0;
+    offset = 0;
     while(file.get(c)){
-      if(fs.blocks[pos].size()<BLOCK_SIZE){
-        fs.blocks[pos].push_back(c);
+      if(offset<BLOCK_SIZE){
+        block_at(pos)[offset++] = c;
       }else{
         for(i=pos;i<MAX_BLOCKS; i++){
           if(fs.bitmap[i]==1){
             fs.fat[pos]= i;
             fs.bitmap[i]=0;
             pos=i;
-            fs.blocks[i].clear();
+            clear_block(i);
+            offset = 0;
             break;
           }
         }
@@ -811,7 +1224,7 @@ void touch_file (cmd_t command){
         arquivo->head = i;
         fs.bitmap[i]=0;
         fs.fat[i]=-1;
-        fs.blocks[i].clear();
+        clear_block(i);
       }
     }
     arquivo->size=4000;
@@ -910,6 +1323,8 @@ void execute(cmd_t command) {
       print_dir(command);
     }else if(command.cmd == "find"){
       find_file(command);
+    }else if(command.cmd == "convert"){
+      convert(command);
     }
   }catch (const char* msg) {
     fail(msg);